@@ -0,0 +1,76 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_CALIBRATION_CACHE_H
+#define FLIR_PTU_DRIVER_CALIBRATION_CACHE_H
+
+#include <flir_ptu_driver/driver.h>
+#include <serial/port_registry.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Calibrations of the units seen by this process, keyed by the identity
+ * of the device they were reached through, so that reconnecting to the
+ * same unit need not read them again. Devices are looked up in a
+ * serial::PortRegistry, which follows hotplug events rather than walking
+ * sysfs on every lookup. Safe to use from any thread.
+ */
+class CalibrationCache
+{
+public:
+  /**
+   * Identifies the device behind a port by its hardware id, e.g.
+   * "USB VID:PID=0403:6001 SNR=FT1234". Symbolic links such as
+   * /dev/serial/by-id are followed. An id without a serial number cannot
+   * tell identical adapters apart, so the port's path is added to it.
+   * \return identity, or empty if the port is not listed, e.g. a pty
+   */
+  std::string identify(const std::string& port);
+
+  /**
+   * Finds the port of a device named by path or by identity. Anything
+   * starting with "/" is a path and is returned as it is; otherwise the
+   * name is matched against hardware ids by serial::PortRegistry rules,
+   * e.g. "SNR=FT1234", "FT1234" or "VID:PID=0403:6001".
+   * \return path of the one matching port, or empty if none or several
+   */
+  std::string resolve(const std::string& name);
+
+  /** \return true if a calibration is known for identity. */
+  bool find(const std::string& identity, Calibration* calibration) const;
+
+  /** Remembers a unit's calibration; an empty identity is ignored. */
+  void store(const std::string& identity, const Calibration& calibration);
+
+private:
+  mutable std::mutex mutex_;
+  std::map<std::string, Calibration> calibrations_;
+  serial::PortRegistry ports_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_CALIBRATION_CACHE_H
@@ -0,0 +1,109 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_COMMAND_COALESCER_H
+#define FLIR_PTU_DRIVER_COMMAND_COALESCER_H
+
+#include <flir_ptu_driver/io_engine.h>
+#include <flir_ptu_driver/ptu_state.h>
+
+#include <mutex>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Sits between the motion topics and the I/O thread, holding at most one
+ * pending motion per axis. A new absolute target replaces whatever was
+ * still waiting for that axis; relative offsets are summed into it. Only
+ * one flush request is queued on the I/O thread at a time, so a fast
+ * publisher can never build up a backlog of stale targets.
+ */
+class CommandCoalescer
+{
+public:
+  /**
+   * \param io engine to send motion requests on
+   * \param state if given, told about the targets sent so that its
+   *        extrapolation stops there
+   */
+  explicit CommandCoalescer(IOEngine* io, PTUState* state = NULL);
+
+  /** Replaces any pending motion with an absolute target for both axes.
+   * \param pan desired pan position in radians
+   * \param tilt desired tilt position in radians
+   * \param panspeed desired pan speed in radians/second
+   * \param tiltspeed desired tilt speed in radians/second
+   */
+  void setTarget(float pan, float tilt, float panspeed, float tiltspeed);
+
+  /** Adds a relative move to the pending motion for both axes.
+   * \param pan pan offset in radians
+   * \param tilt tilt offset in radians
+   */
+  void addOffset(float pan, float tilt);
+
+  /** Replaces any pending motion with a velocity for both axes, putting
+   * the unit in velocity mode. A later target or offset returns it to
+   * position mode.
+   * \param pan pan velocity in radians/second
+   * \param tilt tilt velocity in radians/second
+   */
+  void setVelocity(float pan, float tilt);
+
+  /** With minimum_time set, absolute targets for both axes are sent with
+   * PTU::moveFastest, their speeds serving only as caps. */
+  void setMinimumTime(bool minimum_time)
+  {
+    minimum_time_ = minimum_time;
+  }
+
+private:
+  struct Pending
+  {
+    Pending() : absolute(false), offset(false), velocity(false), position(0), speed(0) {}
+
+    bool absolute;   ///< position is a target, speed is valid
+    bool offset;     ///< position is an offset from the current position
+    bool velocity;   ///< speed is a signed velocity, position is unused
+    float position;
+    float speed;
+  };
+
+  /** Queues a flush on the I/O thread unless one is already queued.
+   * Must be called with mutex_ held. */
+  void schedule();
+
+  /** Runs on the I/O thread and sends whatever is pending. */
+  void flush(PTU& pantilt);
+
+  IOEngine* io_;
+  PTUState* state_;
+
+  std::mutex mutex_;
+  Pending pan_;
+  Pending tilt_;
+  bool scheduled_;
+  bool minimum_time_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_COMMAND_COALESCER_H
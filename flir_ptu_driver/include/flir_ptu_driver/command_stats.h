@@ -0,0 +1,109 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_COMMAND_STATS_H
+#define FLIR_PTU_DRIVER_COMMAND_STATS_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Round-trip times, timeouts, NAKs and byte counts of the exchanges with
+ * one unit, kept per command mnemonic. The mnemonic is the command's
+ * letters, with "=" added when it carries a value, so "pp " and "pp100 "
+ * count as "pp" and "pp=". Recording is lock-free and does not allocate,
+ * so the I/O thread can record every exchange while other threads take
+ * snapshots.
+ */
+class CommandStats
+{
+public:
+  /** Distinct mnemonics tracked; any beyond this are not recorded. */
+  static const size_t MAX_MNEMONICS = 32;
+
+  /** Histogram buckets: bucket i counts round trips under 2^(i+1) us. */
+  static const size_t BUCKETS = 24;
+
+  enum Outcome
+  {
+    ACK,      ///< the unit answered "*"
+    NAK,      ///< the unit answered "!"
+    TIMEOUT   ///< no complete response arrived
+  };
+
+  /** Counters of one mnemonic at a point in time. */
+  struct Snapshot
+  {
+    std::string mnemonic;
+    uint64_t count, timeouts, naks;
+    uint64_t bytes_out, bytes_in;
+    uint64_t buckets[BUCKETS];
+
+    /** Takes away an earlier snapshot, leaving what happened since. */
+    void subtract(const Snapshot& earlier);
+
+    /** \return estimated round trip in seconds below which a fraction q
+     * of the exchanges fell, or 0 if there were none */
+    double percentile(double q) const;
+  };
+
+  CommandStats();
+
+  /**
+   * Records one exchange.
+   * \param command command as sent, with its delimiter
+   * \param length length of command
+   * \param nanoseconds from sending the command to the end of its response
+   * \param bytes_in length of the response
+   * \param outcome how the unit answered
+   */
+  void record(const char* command, size_t length, uint64_t nanoseconds,
+              size_t bytes_in, Outcome outcome);
+
+  /** Outcome of a response as read by the driver. */
+  static Outcome outcome(const std::string& response);
+
+  /** Copies the counters of every mnemonic seen so far. */
+  void snapshot(std::vector<Snapshot>* snapshots) const;
+
+private:
+  struct Entry
+  {
+    std::atomic<uint32_t> key;  ///< packed mnemonic, 0 while unused
+    std::atomic<uint64_t> count, timeouts, naks;
+    std::atomic<uint64_t> bytes_out, bytes_in;
+    std::atomic<uint64_t> buckets[BUCKETS];
+  };
+
+  static uint32_t key(const char* command, size_t length);
+  Entry* find(uint32_t key);
+
+  Entry entries_[MAX_MNEMONICS];
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_COMMAND_STATS_H
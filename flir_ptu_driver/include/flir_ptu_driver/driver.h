@@ -33,11 +33,19 @@
 
 // serial defines
 #define PTU_DEFAULT_BAUD 9600
+#define PTU_MAX_BAUD 115200
 #define PTU_BUFFER_LEN 255
 #define PTU_DEFAULT_PORT "/dev/ttyUSB0"
 #define PTU_DEFAULT_HZ 10
+#define PTU_DEFAULT_IDLE_HZ 2
 #define PTU_DEFAULT_VEL 0.0
 
+#define PTU_SPEED_UNKNOWN INT_MIN
+#define PTU_MODE_UNKNOWN 0
+#define PTU_AWAIT_TIMEOUT 30.0
+#define PTU_RECONNECT_MIN 0.05
+#define PTU_RECONNECT_MAX 2.0
+
 // command defines
 #define PTU_PAN 'p'
 #define PTU_TILT 't'
@@ -45,10 +53,21 @@
 #define PTU_MAX 'x'
 #define PTU_MIN_SPEED 'l'
 #define PTU_MAX_SPEED 'u'
+#define PTU_ACCELERATION 'a'
+#define PTU_BASE_SPEED 'b'
 #define PTU_VELOCITY 'v'
 #define PTU_POSITION 'i'
 
+#include <flir_ptu_driver/command_stats.h>
+#include <flir_ptu_driver/motion_profile.h>
+#include <flir_ptu_driver/protocol.h>
+#include <flir_ptu_driver/traffic_recorder.h>
+
+#include <chrono>
+#include <climits>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace serial
 {
@@ -58,6 +77,27 @@ class Serial;
 namespace flir_ptu_driver
 {
 
+/**
+ * Arrival times of the responses to getState, as reported by
+ * serial::Serial::getReadTimestamp: nanoseconds on the monotonic clock,
+ * or 0 where the port cannot tell.
+ */
+struct StateStamps
+{
+  uint64_t pan, tilt, panspeed, tiltspeed;
+};
+
+/**
+ * What initialize reads from the unit about its axes: resolution in
+ * radians/count, and position and speed limits in counts.
+ */
+struct Calibration
+{
+  float pan_resolution, tilt_resolution;
+  int pan_min, pan_max, tilt_min, tilt_max;
+  int pan_speed_min, pan_speed_max, tilt_speed_min, tilt_speed_max;
+};
+
 class PTU
 {
 public:
@@ -65,16 +105,45 @@ public:
    * \param ser serial::Serial instance ready to communciate with device.
    */
   explicit PTU(serial::Serial* ser) :
-    ser_(ser), initialized_(false), is_dry_run_(false)
+    axes_(), ModeAcked(PTU_MODE_UNKNOWN), ser_(ser), initialized_(false), is_dry_run_(false),
+    recorder_(NULL)
   {
+    forgetSettings();
   }
 
-  /** \return true if initialization succeeds. */
-  bool initialize();
+  /**
+   * Sets up terse, echo-free feedback in position mode and reads the
+   * unit's calibration.
+   * \param cached calibration read from this unit before, e.g. on an
+   *        earlier connection. It is used when the unit reports the same
+   *        pan resolution, saving the other nine queries.
+   * \return true if initialization succeeds.
+   */
+  bool initialize(const Calibration* cached = NULL);
+
+  /** \return the calibration read by initialize. */
+  Calibration calibration() const;
+
+  /**
+   * Moves the host link to the fastest rate the unit accepts, trying the
+   * standard rates from max_baud downwards with the "@(baud,0,0)" command.
+   * Each switch is verified with a query at the new rate; if that fails,
+   * both ends are returned to the previous rate. Call after initialize,
+   * since the exchange expects terse, echo-free responses.
+   * \param max_baud highest baud rate to try
+   * \return baud rate in use afterwards
+   */
+  uint32_t negotiateBaud(uint32_t max_baud = PTU_MAX_BAUD);
 
   /**  \return true if PTU software motion limits are disabled. */
   bool disableLimits();
 
+  /** \return true if software position limits are being enforced. */
+  bool limitsEnabled()
+  {
+    return Lim;
+  }
+
   /** \return true if the serial port is open and PTU initialized. */
   bool initialized();
 
@@ -90,49 +159,129 @@ public:
    */
   float getSpeed(char type);
 
+  /**
+   * Reads pan and tilt position and speed in one pipelined exchange:
+   * the four queries are written together and the four responses are
+   * parsed in order, so a sample costs one round trip instead of four.
+   * \param pan pan position in radians
+   * \param tilt tilt position in radians
+   * \param panspeed pan speed in radians/second
+   * \param tiltspeed tilt speed in radians/second
+   * \param stamps if given, when each response started to arrive
+   * \return True if all four responses were valid
+   */
+  bool getState(float* pan, float* tilt, float* panspeed, float* tiltspeed,
+                StateStamps* stamps = NULL);
+
   /**
    * \param type 'p' or 't'
    * \return resolution in radians/count
    */
-  float getResolution(char type)
+  float getResolution(char type) const
   {
-    return (type == PTU_TILT ? tr : pr);
+    return axis(type).resolution;
+  }
+
+  /**
+   * As getResolution(char), for an axis fixed at compile time.
+   * \tparam A protocol::Pan or protocol::Tilt
+   */
+  template <class A>
+  float getResolution() const
+  {
+    return axes_[A::index].resolution;
   }
 
   /**
    * \param type 'p' or 't'
    * \return Minimum position in radians
    */
-  float getMin(char type)
+  float getMin(char type) const
   {
-    return getResolution(type) * (type == PTU_TILT ? TMin : PMin);
+    return axis(type).resolution * axis(type).min;
   }
   /**
    * \param type 'p' or 't'
    * \return Maximum position in radians
    */
-  float getMax(char type)
+  float getMax(char type) const
   {
-    return getResolution(type) * (type == PTU_TILT ? TMax : PMax);
+    return axis(type).resolution * axis(type).max;
   }
 
   /**
    * \param type 'p' or 't'
    * \return Minimum speed in radians/second
    */
-  float getMinSpeed(char type)
+  float getMinSpeed(char type) const
   {
-    return getResolution(type) * (type == PTU_TILT ? TSMin : PSMin);
+    return axis(type).resolution * axis(type).min_speed;
   }
   /**
    * \param type 'p' or 't'
    * \return Maximum speed in radians/second
    */
-  float getMaxSpeed(char type)
+  float getMaxSpeed(char type) const
   {
-    return getResolution(type) * (type == PTU_TILT ? TSMax : PSMax);
+    return axis(type).resolution * axis(type).max_speed;
   }
 
+  /**
+   * The unit is asked only the first time, or after a reset; afterwards
+   * the value last read or set is returned.
+   * \param type 'p' or 't'
+   * \return acceleration in radians/second^2, or -1 on error
+   */
+  float getAcceleration(char type);
+
+  /**
+   * sets the acceleration moves ramp at, above the base speed. The
+   * command is skipped if the unit already has it.
+   * \param type 'p' or 't'
+   * \param acceleration desired acceleration in radians/second^2
+   * \return True if successfully sent command
+   */
+  bool setAcceleration(char type, float acceleration);
+
+  /**
+   * Cached as getAcceleration is.
+   * \param type 'p' or 't'
+   * \return speed in radians/second a move starts at without ramping,
+   * or -1 on error
+   */
+  float getBaseSpeed(char type);
+
+  /**
+   * sets the speed moves start at without ramping, at most the maximum
+   * speed. The command is skipped if the unit already has it.
+   * \param type 'p' or 't'
+   * \param speed desired base speed in radians/second
+   * \return True if successfully sent command
+   */
+  bool setBaseSpeed(char type, float speed);
+
+  /**
+   * Describes how an axis moves, for planMove, from the cached speed
+   * limits, acceleration and base speed.
+   * \param type 'p' or 't'
+   * \return false if the acceleration or base speed could not be read
+   */
+  bool getProfile(char type, AxisProfile* profile);
+
+  /**
+   * Moves both axes in minimum time, in one slaved group: the speeds are
+   * planned by planMove from the axes' profiles and current positions,
+   * so both arrive together.
+   * \param pan desired pan position in radians
+   * \param tilt desired tilt position in radians
+   * \param pan_max_speed if positive, a cap on the pan speed
+   * \param tilt_max_speed if positive, a cap on the tilt speed
+   * \param block block until the move is finished, see awaitCompletion
+   * \return True if every command was acknowledged
+   */
+  bool moveFastest(float pan, float tilt, float pan_max_speed = 0, float tilt_max_speed = 0,
+                   bool block = false);
+
   /** Setter for the dry run private member
     * If this is set to true, then the constraints around initilaization
     * state are loosened, permitting the use of the PTU driver, even
@@ -143,7 +292,8 @@ public:
 
   /**
    * Moves the PTU to the desired position. If Block is true,
-   * the call blocks until the desired position is reached
+   * the call blocks until the desired position is reached, see
+   * awaitCompletion
    * \param type 'p' or 't'
    * \param pos desired position in radians
    * \param Block block until ready
@@ -151,6 +301,25 @@ public:
   */
   bool setPosition(char type, float pos, bool Block = false);
 
+  /**
+   * Moves both axes to absolute positions at the given speeds in one
+   * slaved group, written in a single pipelined exchange and run with
+   * "I" once every command is acknowledged, so the axes start together.
+   * If the unit refuses one, the axes stop where they are instead of
+   * running part of the group. Nothing is sent if either position is
+   * out of range.
+   * A speed the unit cannot do is reported and left out, and a speed the
+   * unit has already acknowledged is not sent again.
+   * \param pan desired pan position in radians
+   * \param tilt desired tilt position in radians
+   * \param panspeed desired pan speed in radians/second
+   * \param tiltspeed desired tilt speed in radians/second
+   * \param block block until the move is finished, see awaitCompletion
+   * \return True if every command was acknowledged
+   */
+  bool setPositionAndSpeed(float pan, float tilt, float panspeed, float tiltspeed,
+                           bool block = false);
+
   /**
    * Moves the PTU to the desired offset. If Block is true,
    * the call blocks until the desired position is reached
@@ -174,7 +343,8 @@ public:
 
 
   /**
-   * sets the desired speed in radians/second
+   * sets the desired speed in radians/second. The command is skipped if
+   * the unit has already acknowledged the same speed.
    * \param type 'p' or 't'
    * \param speed desired speed in radians/second
    * \return True if successfully sent command
@@ -182,24 +352,99 @@ public:
   bool setSpeed(char type, float speed);
 
   /**
-   * set the control mode, position or velocity
+   * sets the signed speed in radians/second, for use in velocity mode.
+   * Speeds too slow for the unit become a stop, and speeds beyond its
+   * maximum are clamped. As with setSpeed, an unchanged speed is not
+   * sent again.
+   * \param type 'p' or 't'
+   * \param speed desired speed in radians/second
+   * \return True if successfully sent command
+  */
+  bool setVelocity(char type, float speed);
+
+  /**
+   * set the control mode, position or velocity. The command is skipped
+   * if the unit is already known to be in that mode.
    * \param type 'v' for velocity, 'i' for position
    * \return True if successfully sent command
    */
   bool setMode(char type);
 
   /**
-   * get the control mode, position or velocity
+   * get the control mode, position or velocity. The unit is only asked
+   * when the mode is not already known from an acknowledged setMode or
+   * an earlier query.
    * \return 'v' for velocity, 'i' for position
    */
   char getMode();
 
+  /**
+   * Blocks until all motion has finished, using the unit's await command
+   * rather than polling position, so the link stays quiet meanwhile.
+   * Prefer the non-blocking MotionMonitor when the caller has other work.
+   * \param timeout seconds to wait
+   * \return True if motion finished in time
+   */
+  bool awaitCompletion(double timeout = PTU_AWAIT_TIMEOUT);
+
   bool home();
 
+  /** Writes bytes to the unit without reading any response. Prefer
+   * sendQueuedCommands, which keeps the response stream in step. */
   void  sendCommand(const unsigned char *data, unsigned int length);
 
+  /**
+   * Writes out the raw payloads queued on the port with
+   * serial::Serial::enqueueWrite and reads back their responses. Since the
+   * payloads may change modes or speeds, the acknowledged mode and speeds
+   * are forgotten.
+   * \param count number of responses to read, as protocol::countCommands
+   *        gives for the payloads queued so far
+   * \return the response lines, concatenated; if one times out, input is
+   *         flushed and the responses so far are returned
+   */
+  std::string sendQueuedCommands(size_t count);
+
+  /**
+   * Sends comma separated commands slaved together, e.g. "po100,to-50",
+   * written in one pipelined exchange and run together once all are
+   * acknowledged. If one is refused none of them runs: both axes are
+   * stopped where they are instead. The unit is left in immediate mode.
+   * \param commands commands without their terminating spaces
+   * \param do_wait also wait for the motion to finish
+   * \return "*" if every command was acknowledged, or else the first
+   *         response which was not
+   */
   std::string sendSlavedCommands (std::string commands, bool do_wait=false);
 
+  /**
+   * Sends preformatted commands slaved together in a single pipelined
+   * exchange, so that they take effect at once without waiting for the
+   * motion to finish. A refused command stops the group as in
+   * sendSlavedCommands.
+   * \param commands space-terminated commands, e.g. from planTrajectory
+   * \return True if every command was acknowledged
+   */
+  bool sendSlavedGroup(const std::vector<std::string>& commands);
+
+  /** Stops both axes where they are.
+   * \return True if successfully sent command */
+  bool halt();
+
+  /** Statistics of the exchanges with the unit, by command. Safe to
+   * snapshot from any thread. */
+  const CommandStats& stats() const
+  {
+    return stats_;
+  }
+
+  /** Records all traffic with the unit from now on, or stops recording
+   * if recorder is NULL. Set it before posting requests which use it. */
+  void setRecorder(TrafficRecorder* recorder)
+  {
+    recorder_ = recorder;
+  }
+
 private:
   /** get radian/count resolution
    * \param type 'p' or 't'
@@ -215,18 +460,74 @@ private:
    */
   int getLimit(char type, char limType);
 
-  // Position Limits
-  int TMin;  ///< Min Tilt in Counts
-  int TMax;  ///< Max Tilt in Counts
-  int PMin;  ///< Min Pan in Counts
-  int PMax;  ///< Max Pan in Counts
+  /** Calibration and cached settings of one axis. */
+  struct AxisState
+  {
+    float resolution;  ///< rads/count
+    int min;           ///< Min position in Counts
+    int max;           ///< Max position in Counts
+    int min_speed;     ///< Min speed in Counts/second
+    int max_speed;     ///< Max speed in Counts/second
+
+    // As last read or acknowledged, or PTU_SPEED_UNKNOWN
+    int speed_acked;   ///< Speed in Counts/second
+    int acceleration;  ///< Acceleration in Counts/second^2
+    int base_speed;    ///< Base speed in Counts/second
+  };
+
+  /** Indexed by protocol::axisIndex, so that picking an axis by its
+   * letter is arithmetic rather than a branch. */
+  AxisState axes_[protocol::AXIS_COUNT];
+
+  AxisState& axis(char type)
+  {
+    return axes_[protocol::axisIndex(type)];
+  }
+
+  const AxisState& axis(char type) const
+  {
+    return axes_[protocol::axisIndex(type)];
+  }
+
+  /** Forgets the speeds acknowledged for both axes. */
+  void forgetSpeeds()
+  {
+    for (size_t i = 0; i < protocol::AXIS_COUNT; i++)
+    {
+      axes_[i].speed_acked = PTU_SPEED_UNKNOWN;
+    }
+  }
+
+  /** Forgets every cached axis setting, for when the unit may have
+   * changed or reset them. */
+  void forgetSettings()
+  {
+    forgetSpeeds();
+    for (size_t i = 0; i < protocol::AXIS_COUNT; i++)
+    {
+      axes_[i].acceleration = axes_[i].base_speed = PTU_SPEED_UNKNOWN;
+    }
+  }
+
   bool Lim;  ///< Position Limits enabled 
+  char ModeAcked;  ///< Control mode, or PTU_MODE_UNKNOWN
 
-  // Speed Limits
-  int TSMin;  ///< Min Tilt Speed in Counts/second
-  int TSMax;  ///< Max Tilt Speed in Counts/second
-  int PSMin;  ///< Min Pan Speed in Counts/second
-  int PSMax;  ///< Max Pan Speed in Counts/second
+  /** Reads an axis setting into its cache, unless already cached.
+   * \return setting in counts, or PTU_SPEED_UNKNOWN on error */
+  int getSetting(char type, char op, int* cached);
+
+  /** Sends an axis setting, unless already cached, and caches it. */
+  bool setSetting(char type, char op, int count, int* cached);
+
+  /** Stages commands after "s" in one pipelined exchange and, if every
+   * one is acknowledged, runs them with "I". Otherwise abandonSlaved.
+   * \return response to "I", or the first response which was not an
+   *         acknowledgement */
+  std::string sendSlaved(const std::vector<std::string>& commands);
+
+  /** Drops a partly staged group by staging both axes at their current
+   * positions and running that, leaving the unit in immediate mode. */
+  void abandonSlaved();
 
 protected:
   /** Sends a string to the PTU
@@ -236,12 +537,59 @@ protected:
    */
   std::string sendCommand(std::string command);
 
+  /** Sends a command and reads its response into a buffer which is reused
+   * between exchanges, so a steady stream of queries does not allocate.
+   *
+   * \param command command to be sent, space terminated
+   * \param length number of characters in command
+   * \return response from unit, valid until the next exchange
+   */
+  const std::string& query(const char* command, size_t length);
+
+  /** Sends several commands in a single write and reads back one
+   * response per command, in order.
+   *
+   * \param commands space-terminated commands to be sent
+   * \return response strings from unit, one per command. A response
+   *         which timed out is returned empty.
+   */
+  std::vector<std::string> sendCommands(const std::vector<std::string>& commands);
+
+  /** Switches both the unit and the serial port to a new baud rate.
+   *
+   * \param baud rate to switch to
+   * \return true if the unit answered a query at the new rate
+   */
+  bool switchBaud(uint32_t baud);
+
+  /** Records the exchange of one command in stats().
+   * \param sent when the command was written
+   * \param response what was read back for it */
+  void record(const char* command, size_t length,
+              std::chrono::steady_clock::time_point sent, const std::string& response);
+
+  /** Adds bytes written to or read from the unit to the recording, if
+   * there is one. */
+  void trace(TrafficRecorder::Direction direction, const char* data, size_t length)
+  {
+    if (recorder_) recorder_->record(direction, data, length);
+  }
+
+  void trace(TrafficRecorder::Direction direction, const std::string& data)
+  {
+    trace(direction, data.data(), data.length());
+  }
+
+  /** Notes the port's current rate in the recording. */
+  void traceBaud();
+
   serial::Serial* ser_;
   bool initialized_;
   bool is_dry_run_;
-
-  float tr;  ///< tilt resolution (rads/count)
-  float pr;  ///< pan resolution (rads/count)
+  std::string rx_;  ///< Response buffer reused by query
+  std::string tx_;  ///< What sendQueuedCommands wrote, for the recording
+  CommandStats stats_;
+  TrafficRecorder* recorder_;
 };
 
 }  // namespace flir_ptu_driver
@@ -0,0 +1,169 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_IO_ENGINE_H
+#define FLIR_PTU_DRIVER_IO_ENGINE_H
+
+#include <flir_ptu_driver/driver.h>
+#include <serial/serial.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Owns the serial port and PTU for one unit and serves requests against
+ * them from a dedicated thread. Requests may be posted from any thread;
+ * they run one at a time, and the caller gets a future for the result
+ * instead of blocking on the serial link. Commands run in the order they
+ * were posted and ahead of any queued state polls, so a poll never
+ * delays motion by more than the exchange already on the wire. A request
+ * failing with a serial error marks the link lost, for the owner to
+ * reopen it. The port is put in single reader mode: read it only through
+ * posted requests.
+ *
+ * Each engine has its own thread rather than sharing a serial::EventLoop:
+ * PTU's exchanges are blocking request/response sequences, and an await
+ * may hold the link for seconds, which on a shared thread would stall
+ * every other unit.
+ */
+class IOEngine
+{
+public:
+  enum Priority
+  {
+    COMMAND,  ///< motion and configuration, run first
+    POLL      ///< state queries, run when no command is waiting
+  };
+
+  IOEngine();
+
+  /** Stops the I/O thread, as stop does. */
+  ~IOEngine();
+
+  /** Drops the requests still queued, whose futures then report a broken
+   * promise, and waits for the one running to finish. No request runs
+   * afterwards. Must not be called from the I/O thread. */
+  void stop();
+
+  /** Serial port owned by this engine. Configure and open it before
+   * posting any request which talks to the unit. */
+  serial::Serial& serial()
+  {
+    return ser_;
+  }
+
+  /** PTU owned by this engine. Outside a posted request, only the cached
+   * getters (resolution and limits) may be called, and only while no
+   * request can be initializing the unit, such as before polling starts;
+   * otherwise copy what is needed, e.g. PTU::calibration, in a request. */
+  PTU& ptu()
+  {
+    return ptu_;
+  }
+
+  /** Queues a request to be run on the I/O thread.
+   * \param request function to run against the PTU
+   * \param priority queue to run the request from
+   * \return future holding the request's result
+   */
+  template<typename Result>
+  std::future<Result> post(std::function<Result(PTU&)> request, Priority priority = COMMAND)
+  {
+    std::shared_ptr<std::packaged_task<Result()> > task(
+      new std::packaged_task<Result()>([this, request]() -> Result
+      {
+        // The future still reports the error; the flag tells the owner
+        try
+        {
+          return request(ptu_);
+        }
+        catch (const serial::SerialException&)
+        {
+          link_lost_ = true;
+          throw;
+        }
+        catch (const serial::IOException&)
+        {
+          link_lost_ = true;
+          throw;
+        }
+        catch (const serial::PortNotOpenedException&)
+        {
+          link_lost_ = true;
+          throw;
+        }
+      }));
+    std::future<Result> result = task->get_future();
+    enqueue([task]() { (*task)(); }, priority);
+    return result;
+  }
+
+  /** \return true once a request has failed with a serial error, such as
+   * the adapter going away, until resetLinkLost is called. */
+  bool linkLost() const
+  {
+    return link_lost_;
+  }
+
+  /** Clears linkLost, once the port has been reopened. */
+  void resetLinkLost()
+  {
+    link_lost_ = false;
+  }
+
+  /** \return true if called from the I/O thread. */
+  bool onIOThread() const
+  {
+    return std::this_thread::get_id() == thread_.get_id();
+  }
+
+private:
+  // Disable copy constructors
+  IOEngine(const IOEngine&);
+  IOEngine& operator=(const IOEngine&);
+
+  void enqueue(std::function<void()> task, Priority priority);
+  void run();
+
+  serial::Serial ser_;
+  PTU ptu_;
+
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()> > commands_;
+  std::deque<std::function<void()> > polls_;
+  bool stopping_;
+  std::atomic<bool> link_lost_;
+
+  std::thread thread_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_IO_ENGINE_H
@@ -0,0 +1,82 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_MESSAGE_POOL_H
+#define FLIR_PTU_DRIVER_MESSAGE_POOL_H
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Messages to publish by shared pointer, recycled once nobody else holds
+ * them. Publishing by pointer lets subscribers in the same process, such
+ * as nodelets, take the message without a copy; recycling it afterwards
+ * means steady publishing reuses the strings and vectors of a few
+ * messages rather than allocating fresh ones. A message is handed out
+ * as it was last published, so the caller only rewrites what changes.
+ * Not thread safe.
+ */
+template <class M>
+class MessagePool
+{
+public:
+  typedef boost::shared_ptr<M> Ptr;
+
+  /** \param size messages kept for reuse */
+  explicit MessagePool(size_t size = 4) : size_(size)
+  {
+  }
+
+  /** Sets what new messages start as, and forgets the old ones. */
+  void setPrototype(const M& prototype)
+  {
+    prototype_ = prototype;
+    pool_.clear();
+  }
+
+  /**
+   * \return a message held by nobody else, or a copy of the prototype if
+   * subscribers still hold every pooled one
+   */
+  Ptr acquire()
+  {
+    for (size_t i = 0; i < pool_.size(); i++)
+    {
+      if (pool_[i].unique()) return pool_[i];
+    }
+    Ptr message = boost::make_shared<M>(prototype_);
+    if (pool_.size() < size_) pool_.push_back(message);
+    return message;
+  }
+
+private:
+  M prototype_;
+  size_t size_;
+  std::vector<Ptr> pool_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_MESSAGE_POOL_H
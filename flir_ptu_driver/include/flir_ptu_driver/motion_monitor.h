@@ -0,0 +1,78 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_MOTION_MONITOR_H
+#define FLIR_PTU_DRIVER_MOTION_MONITOR_H
+
+#include <flir_ptu_driver/ptu_state.h>
+
+#include <future>
+#include <list>
+#include <mutex>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Tells callers when a move has finished without anyone waiting on the
+ * serial link. Completion is judged from the polled state, so it costs no
+ * extra traffic; the poller calls update after each sample.
+ */
+class MotionMonitor
+{
+public:
+  /** Fails any moves still being watched. */
+  ~MotionMonitor();
+
+  /**
+   * Starts watching for the unit to come to rest at a target: both axes
+   * within tolerance of it, and moving no more than tolerance per second
+   * between polls, so passing through the target does not count. A newer
+   * watch supersedes older ones, whose futures then report false.
+   * \param pan target pan position in radians
+   * \param tilt target tilt position in radians
+   * \param tolerance how close both axes must be, in radians
+   * \param timeout seconds before giving up
+   * \return future set to true once the target is reached, or false on
+   *         timeout or when superseded
+   */
+  std::future<bool> watch(float pan, float tilt, float tolerance, double timeout);
+
+  /** Checks the watched moves against a new sample. */
+  void update(const PTUState& state);
+
+  /** Fails every move being watched, e.g. when the unit is halted. */
+  void cancel();
+
+private:
+  struct Watch
+  {
+    float pan, tilt, tolerance;
+    PTUState::Clock::time_point deadline;
+    std::promise<bool> done;
+  };
+
+  std::mutex mutex_;
+  std::list<Watch> watches_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_MOTION_MONITOR_H
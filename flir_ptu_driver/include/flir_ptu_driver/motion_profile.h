@@ -0,0 +1,76 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_MOTION_PROFILE_H
+#define FLIR_PTU_DRIVER_MOTION_PROFILE_H
+
+namespace flir_ptu_driver
+{
+
+/**
+ * How one axis makes a position move: it jumps to its base speed, ramps
+ * at its acceleration up to the commanded speed, cruises, and ramps back
+ * down, or turns around halfway if the move is too short to reach the
+ * commanded speed. Radians and seconds throughout.
+ */
+struct AxisProfile
+{
+  double base_speed;    ///< reached at once, without ramping
+  double acceleration;  ///< per second, above the base speed
+  double min_speed;     ///< slowest commanded speed the unit takes
+  double max_speed;     ///< fastest commanded speed the unit takes
+};
+
+/** The speeds of a move of both axes, and how long it takes. */
+struct MovePlan
+{
+  double pan_speed;
+  double tilt_speed;
+  double duration;
+};
+
+/**
+ * \param distance how far to move, either way
+ * \param speed commanded speed, clamped to the axis's range
+ * \return seconds the move takes
+ */
+double profileDuration(const AxisProfile& axis, double distance, double speed);
+
+/**
+ * The inverse of profileDuration.
+ * \return commanded speed at which distance takes duration, clamped to
+ * the axis's range, so the move may be faster than asked
+ */
+double profileSpeed(const AxisProfile& axis, double distance, double duration);
+
+/**
+ * Plans the fastest move of both axes the unit can make as a single
+ * slaved command. The axis which needs longer goes at its top speed and
+ * the other is slowed to arrive with it, so the path is as straight as
+ * the profiles allow at no cost in time.
+ * \param pan_distance pan distance, either way
+ * \param tilt_distance tilt distance, either way
+ */
+MovePlan planMove(const AxisProfile& pan, const AxisProfile& tilt,
+                  double pan_distance, double tilt_distance);
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_MOTION_PROFILE_H
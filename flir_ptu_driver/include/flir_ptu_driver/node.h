@@ -0,0 +1,226 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_NODE_H
+#define FLIR_PTU_DRIVER_NODE_H
+
+#include <actionlib/server/simple_action_server.h>
+#include <control_msgs/FollowJointTrajectoryAction.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <flir_ptu_driver/calibration_cache.h>
+#include <flir_ptu_driver/command_coalescer.h>
+#include <flir_ptu_driver/driver.h>
+#include <flir_ptu_driver/io_engine.h>
+#include <flir_ptu_driver/message_pool.h>
+#include <flir_ptu_driver/motion_monitor.h>
+#include <flir_ptu_driver/poll_scheduler.h>
+#include <flir_ptu_driver/ptu_state.h>
+#include <flir_ptu_driver/raw_command_queue.h>
+#include <flir_ptu_driver/simulator.h>
+#include <flir_ptu_driver/traffic_recorder.h>
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+#include <std_msgs/Bool.h>
+#include <flir_ptu_driver/PtuDirectControl.h>
+#include <geometry_msgs/Twist.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * The ROS interface to one or more PTUs: topics, the trajectory action,
+ * diagnostics and polling. Run by ptu_node, or loaded into a nodelet
+ * manager as flir_ptu_driver/PTUNodelet so that in-process subscribers
+ * and publishers exchange messages by pointer.
+ */
+class Node
+{
+public:
+  /** \param node_handle namespace of topics
+   * \param private_node_handle namespace of parameters
+   * \param calibrations units already calibrated, shared across
+   * reconnects; may be NULL */
+  Node(ros::NodeHandle& node_handle, ros::NodeHandle& private_node_handle,
+       CalibrationCache* calibrations);
+  ~Node();
+
+  // Service Control
+  void connect();
+  bool ok()
+  {
+    return !m_devices.empty();
+  }
+  void disconnect();
+
+  // Service Execution
+  void spinCallback(const ros::TimerEvent&);
+
+protected:
+  /** Everything belonging to one PTU and its serial port. */
+  struct Device
+  {
+    Device() : io(NULL), coalescer(NULL), direct(NULL), trajectory_server(NULL), simulator(NULL),
+               vel_active(false), refresh_mode(true), stopping(false),
+               moving(false), byte_time_ns(0), poll_seconds(0), link_lost(false), resume_backoff(0) {}
+
+    std::string port;
+    std::string joint_name_prefix;
+    // Key of the unit's calibration in the cache, or empty; the port
+    // above is ~port as given, a path or an identity
+    std::string identity;
+    IOEngine* io;
+    CommandCoalescer* coalescer;
+    RawCommandQueue* direct;
+    actionlib::SimpleActionServer<control_msgs::FollowJointTrajectoryAction>* trajectory_server;
+    // With ~simulate, the unit behind port
+    Simulator* simulator;
+
+    ros::Subscriber joint_sub;
+    ros::Subscriber direct_sub;
+    ros::Publisher direct_pub;
+    ros::Subscriber jog_sub;
+    ros::Subscriber vel_sub;
+    ros::Subscriber reset_sub;
+    ros::Subscriber rotate_rel_sub;
+
+    boost::posix_time::ptime jog_mark;
+
+    // Time of the last cmd_vel, while the unit is being driven by it
+    ros::Time vel_mark;
+    std::atomic<bool> vel_active;
+
+    // Written by polls on the device's I/O thread, readable anywhere
+    PTUState state;
+
+    // Completes watched moves from the polled state
+    MotionMonitor monitor;
+
+    // Mode is refreshed by the next poll after diagnostics asked for it
+    std::atomic<bool> refresh_mode;
+
+    // Set on disconnect, so a running trajectory gives up
+    std::atomic<bool> stopping;
+
+    // Left by the last poll for pollsDone to schedule the next round
+    bool moving;
+    uint32_t byte_time_ns;
+    // How long the poll itself held the link, from its start on the I/O
+    // thread; 0 when it reconnected instead
+    double poll_seconds;
+
+    // Link settings, kept for reopening the port
+    int32_t baud, max_baud;
+    bool limits_enabled, dry_run;
+
+    // Ramp settings applied after each initialize, zero keeps the unit's own
+    double pan_acceleration, tilt_acceleration;
+    double pan_base_speed, tilt_base_speed;
+
+    // While the link is down, polls try to resume it with backoff
+    std::atomic<bool> link_lost;
+    PTUState::Clock::time_point resume_at;
+    double resume_backoff;
+
+    // Link statistics at the previous diagnostics update
+    std::vector<CommandStats::Snapshot> stats_mark;
+    ros::Time stats_time;
+    ros::Publisher stats_pub;
+
+    // With ~record, all traffic with the unit goes to record_path
+    std::string record_path;
+    TrafficRecorder recorder;
+
+    // With ~split_state, the messages for each axis, named once
+    MessagePool<sensor_msgs::JointState> pan_states, tilt_states;
+  };
+  typedef actionlib::SimpleActionServer<control_msgs::FollowJointTrajectoryAction> TrajectoryServer;
+
+  // Callback Methods
+  void cmdCallback(const sensor_msgs::JointState::ConstPtr& msg, Device* device);
+  void ptuDirectControlCallback(const flir_ptu_driver::PtuDirectControl::ConstPtr& msg,
+                                Device* device);
+  void ptuJogCallback(const geometry_msgs::Twist::ConstPtr& msg, Device* device);
+  void velocityCallback(const geometry_msgs::Twist::ConstPtr& msg, Device* device);
+  void resetCallback(const std_msgs::Bool::ConstPtr& msg, Device* device);
+  void rotateRelativeCallback(const geometry_msgs::Twist::ConstPtr& msg, Device* device);
+  void trajectoryCallback(const control_msgs::FollowJointTrajectoryGoalConstPtr& goal, Device* device);
+  void produce_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  // Reports the link statistics of one device since the last update
+  void produceLinkDiagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat,
+                              Device* device, const std::string& suffix);
+
+  // Sleeps until a trajectory time, or returns false if it was cancelled
+  bool waitForTrajectory(const ros::Time& until, Device* device);
+  void stopTrajectory(Device* device);
+  // Halts the unit mid-trajectory and forgets the segment's targets
+  void haltTrajectory(Device* device);
+
+  bool connectDevice(Device* device, ros::NodeHandle& device_node);
+  // Brings up the unit on an open port, on the device's I/O thread
+  bool initializeUnit(Device* device, PTU& pantilt);
+  // Reopens a lost link if its backoff has run out, on the I/O thread
+  void resumeDevice(Device* device, PTU& pantilt);
+
+  // Runs on each device's I/O thread
+  void pollDevice(Device* device, PTU& pantilt);
+  void readState(Device* device, PTU& pantilt);
+  // Runs on the I/O thread of whichever device finished polling last
+  void pollsDone();
+
+  // Publishes the state of every device, extrapolated to the present
+  void publishState();
+  void publishCallback(const ros::TimerEvent&);
+  // Publishes one message per axis, stamped when that axis was read
+  void publishSplitState(Device* device, const PTUState::Sample& sample);
+  // Names the joints of the pooled messages, once devices are connected
+  void prepareStates();
+
+  diagnostic_updater::Updater* m_updater;
+  CalibrationCache* m_calibrations;
+  std::vector<Device*> m_devices;
+  std::atomic<int> m_polls_pending;
+  PollScheduler m_scheduler;
+  PTUState::Clock::time_point m_poll_start;
+  ros::NodeHandle m_node;
+  ros::NodeHandle m_private;
+  ros::Publisher  m_joint_pub;
+  ros::Publisher  m_age_pub;
+  // Messages with a pan and a tilt entry for every device, in order
+  MessagePool<sensor_msgs::JointState> m_joint_states;
+  ros::Timer      m_publish_timer;
+  ros::Timer      m_spin_timer;
+
+  double default_velocity_;
+  double m_jog_step_rads_;
+  double m_jog_time_limit_;
+  double m_vel_timeout;
+  double m_trajectory_lookahead;
+  double m_trajectory_tolerance;
+  bool m_split_state;
+  bool m_publish_link_stats;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_NODE_H
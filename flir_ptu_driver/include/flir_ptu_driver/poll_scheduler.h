@@ -0,0 +1,99 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_POLL_SCHEDULER_H
+#define FLIR_PTU_DRIVER_POLL_SCHEDULER_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Decides when the next round of state polls is due. Polls run at the
+ * active rate while a unit moves and for a hold time after the last
+ * motion or command, then back off by doubling the interval until the
+ * idle rate is reached. Whatever the rate asked for, polls are kept to a
+ * share of the link's time, judged from the byte time of the port and
+ * from how long the polls' own exchanges took, so commands are not
+ * starved. Time a poll spent queued behind commands is not its cost.
+ */
+class PollScheduler
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /** Bytes a state poll puts on the wire: "pp tp ps ts " and four
+   * "* value" responses. */
+  static const size_t POLL_BYTES = 48;
+
+  PollScheduler();
+
+  /** Rates to poll at while moving and at rest, in Hz. */
+  void setRates(double active_hz, double idle_hz);
+
+  /** Seconds to keep the active rate after the last motion or command. */
+  void setHoldTime(double seconds);
+
+  /** Largest fraction of the link's time polls may take, in (0, 1]. */
+  void setLinkShare(double share);
+
+  /** Notes a command, so polling speeds up before the motion shows. */
+  void activity(Clock::time_point now);
+
+  /**
+   * Records a finished round of polls.
+   * \param start when the round was queued
+   * \param end when its last poll finished
+   * \param exchange seconds the longest single poll spent on its link,
+   *        timed on the I/O thread, without any wait in the queue
+   * \param moving whether any unit was seen moving
+   * \param byte_time_ns byte time of the slowest port, or 0 if unknown
+   */
+  void completed(Clock::time_point start, Clock::time_point end, double exchange,
+                 bool moving, uint32_t byte_time_ns);
+
+  /**
+   * \return true if the next round should be queued now. Callers which
+   * check on a timer at the active rate are allowed a quarter of its
+   * period early, so that timer jitter does not skip a round.
+   */
+  bool due(Clock::time_point now) const;
+
+  /** \return seconds between the last round and the next one. */
+  double interval() const;
+
+private:
+  mutable std::mutex mutex_;
+  double active_period_, idle_period_;
+  double hold_time_;
+  double link_share_;
+  double interval_;
+  bool polled_;
+  Clock::time_point last_start_;
+  Clock::time_point last_activity_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_POLL_SCHEDULER_H
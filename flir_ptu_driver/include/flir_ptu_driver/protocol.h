@@ -0,0 +1,240 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_PROTOCOL_H
+#define FLIR_PTU_DRIVER_PROTOCOL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Formatting and parsing for the terse ASCII protocol. Nothing here
+ * allocates: commands are built in caller-supplied buffers, and responses
+ * are read in place from the line the serial port returned.
+ */
+namespace protocol
+{
+
+/** Buffer size which fits any command built by formatCommand. */
+const size_t MAX_COMMAND_LEN = 32;
+
+/**
+ * An axis as a type, so that its commands are fixed at compile time. Only
+ * Axis<'p'> and Axis<'t'> are defined: naming any other axis does not
+ * compile.
+ */
+template <char Letter> struct Axis;
+
+template <> struct Axis<'p'>
+{
+  static constexpr char letter = 'p';
+  static constexpr size_t index = 0;  ///< Position in per-axis tables
+};
+
+template <> struct Axis<'t'>
+{
+  static constexpr char letter = 't';
+  static constexpr size_t index = 1;
+};
+
+typedef Axis<'p'> Pan;
+typedef Axis<'t'> Tilt;
+
+/** Size of per-axis tables. */
+const size_t AXIS_COUNT = 2;
+
+/**
+ * Position of an axis letter known only at run time in per-axis tables.
+ * Computed rather than branched on; as the driver always has, anything
+ * other than 't' is taken to be pan.
+ */
+constexpr size_t axisIndex(char axis)
+{
+  return axis == Tilt::letter;
+}
+
+/** Two-letter mnemonic of an axis command, such as "ps". */
+template <class A, char Op>
+struct Mnemonic
+{
+  static constexpr char text[2] = { A::letter, Op };
+  static constexpr size_t length = sizeof(text);
+};
+
+template <class A, char Op>
+constexpr char Mnemonic<A, Op>::text[2];
+
+/** Space-terminated query for an axis value, such as "ps ". */
+template <class A, char Op>
+struct Query
+{
+  static constexpr char text[3] = { A::letter, Op, ' ' };
+  static constexpr size_t length = sizeof(text);
+};
+
+template <class A, char Op>
+constexpr char Query<A, Op>::text[3];
+
+/** \return true if the unit acknowledged the command ("*"). */
+inline bool isAck(const std::string& response)
+{
+  return !response.empty() && response[0] == '*';
+}
+
+/** \return true if the response is an acknowledgement carrying a value. */
+inline bool hasValue(const std::string& response)
+{
+  return response.length() >= 3 && response[0] == '*';
+}
+
+/**
+ * Counts the commands in raw bytes, taking a command to be anything
+ * followed by a space, CR or LF; each gets one response line.
+ * \param in_command whether the bytes before these ended partway through a
+ *        command; updated to whether these do
+ */
+inline size_t countCommands(const char* data, size_t length, bool* in_command)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    bool delimiter = (data[i] == ' ' || data[i] == '\r' || data[i] == '\n');
+    if (delimiter && *in_command) count++;
+    *in_command = !delimiter;
+  }
+  return count;
+}
+
+/**
+ * Writes the decimal representation of value, without a terminator.
+ * \param out buffer with room for at least 21 characters
+ * \return number of characters written
+ */
+inline size_t formatInt(char* out, long value)
+{
+  char digits[20];
+  size_t n = 0;
+  unsigned long magnitude = value < 0 ? 0UL - static_cast<unsigned long>(value)
+                                      : static_cast<unsigned long>(value);
+  do
+  {
+    digits[n++] = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  }
+  while (magnitude != 0);
+
+  size_t length = 0;
+  if (value < 0) out[length++] = '-';
+  while (n > 0) out[length++] = digits[--n];
+  return length;
+}
+
+/**
+ * Builds a space-terminated axis command such as "pp1200 ".
+ * \param out buffer of at least MAX_COMMAND_LEN characters; the result is
+ *        NUL terminated
+ * \param axis 'p' or 't'
+ * \param op command letter, e.g. 'p' for position or 's' for speed
+ * \param value argument in counts
+ * \return length of the command, excluding the terminator
+ */
+inline size_t formatCommand(char* out, char axis, char op, long value)
+{
+  size_t length = 0;
+  out[length++] = axis;
+  out[length++] = op;
+  length += formatInt(out + length, value);
+  out[length++] = ' ';
+  out[length] = '\0';
+  return length;
+}
+
+/**
+ * As formatCommand above, for an axis and command fixed at compile time:
+ * the mnemonic is copied in whole and only the value is formatted.
+ */
+template <class A, char Op>
+inline size_t formatCommand(char* out, long value)
+{
+  memcpy(out, Mnemonic<A, Op>::text, Mnemonic<A, Op>::length);
+  size_t length = Mnemonic<A, Op>::length;
+  length += formatInt(out + length, value);
+  out[length++] = ' ';
+  out[length] = '\0';
+  return length;
+}
+
+/**
+ * Points at the value of a "* value" response, skipping the status
+ * character and any spaces.
+ * \return NULL when the response carries no value
+ */
+inline const char* valueStart(const std::string& response)
+{
+  if (response.empty()) return NULL;
+  const char* p = response.c_str() + 1;
+  while (*p == ' ') ++p;
+  if (*p == '\0' || *p == '\r' || *p == '\n') return NULL;
+  return p;
+}
+
+/**
+ * Parses an integer response. An empty value reads as zero.
+ * \return false if the value is not a number
+ */
+inline bool parseInt(const std::string& response, long* value)
+{
+  const char* start = valueStart(response);
+  if (!start)
+  {
+    *value = 0;
+    return true;
+  }
+  char* end;
+  *value = strtol(start, &end, 10);
+  return end != start;
+}
+
+/**
+ * Parses a decimal response. An empty value reads as zero.
+ * \return false if the value is not a number
+ */
+inline bool parseDouble(const std::string& response, double* value)
+{
+  const char* start = valueStart(response);
+  if (!start)
+  {
+    *value = 0;
+    return true;
+  }
+  char* end;
+  *value = strtod(start, &end);
+  return end != start;
+}
+
+}  // namespace protocol
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_PROTOCOL_H
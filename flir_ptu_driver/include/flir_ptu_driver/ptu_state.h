@@ -0,0 +1,127 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_PTU_STATE_H
+#define FLIR_PTU_DRIVER_PTU_STATE_H
+
+#include <flir_ptu_driver/driver.h>
+
+#include <chrono>
+#include <mutex>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Last known state of one PTU, written by the poller and readable from
+ * any thread without touching the serial link. Between polls, positions
+ * are extrapolated from the last sample so that state can be published
+ * faster than the link can be polled.
+ */
+class PTUState
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /** Position and speed of both axes at a point in time. */
+  struct Sample
+  {
+    float pan, tilt;            ///< radians
+    float panspeed, tiltspeed;  ///< radians/second, as polled
+    float panrate, tiltrate;    ///< radians/second, measured between the last two polls
+    Clock::time_point pan_stamp, tilt_stamp;  ///< time each position describes
+    double age;  ///< seconds since the oldest underlying response, or -1 if none yet
+  };
+
+  PTUState();
+
+  /** Records a polled sample, with both axes read at the same time. */
+  void update(float pan, float tilt, float panspeed, float tiltspeed,
+              Clock::time_point stamp);
+
+  /** Records a polled sample, with the time each axis position was read. */
+  void update(float pan, float tilt, float panspeed, float tiltspeed,
+              Clock::time_point pan_stamp, Clock::time_point tilt_stamp);
+
+  /** Records the target of an absolute move, which extrapolation will
+   * not overshoot. */
+  void setTarget(char type, float position);
+
+  /** Forgets the targets, e.g. after a relative move. */
+  void clearTargets();
+
+  /** Records the control mode, 'i' or 'v'. */
+  void setMode(char mode);
+
+  /** \return the last recorded control mode, or -1 if not known. */
+  char mode() const;
+
+  /**
+   * Predicts the state at a point in time from the last samples. The
+   * rate and acceleration seen between polls are carried forward, an
+   * axis never runs past its commanded target, and nothing is
+   * extrapolated more than max_horizon seconds beyond the newer of the
+   * two axis readings; the sample stamps say which time was reached.
+   * Speeds are reported as polled, since in position mode the unit
+   * reports the commanded speed rather than the current one.
+   * \param now time to predict for
+   * \param sample predicted state, with the age of the underlying poll
+   * \return false if no sample has been recorded yet
+   */
+  bool predict(Clock::time_point now, Sample* sample) const;
+
+  /**
+   * The last polled sample as it was read, without extrapolation, stamped
+   * with the time each axis was read.
+   * \return false if no sample has been recorded yet
+   */
+  bool last(Sample* sample) const;
+
+  /** Limit on how far predict extrapolates past the last sample. */
+  void setMaxHorizon(double seconds);
+
+private:
+  struct Axis
+  {
+    Axis() : position(0), speed(0), rate(0), acceleration(0), target(0), has_target(false) {}
+
+    float position;
+    float speed;         ///< as reported by the unit
+    float rate;          ///< measured between the last two polls
+    float acceleration;  ///< measured change in rate
+    float target;
+    bool has_target;
+    Clock::time_point stamp;  ///< when position was read
+  };
+
+  float predictAxis(const Axis& axis, double dt) const;
+  void updateAxis(Axis* axis, float position, float speed, Clock::time_point stamp);
+
+  mutable std::mutex mutex_;
+  Axis pan_;
+  Axis tilt_;
+  bool valid_;
+  char mode_;
+  double max_horizon_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_PTU_STATE_H
@@ -0,0 +1,76 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_RAW_COMMAND_QUEUE_H
+#define FLIR_PTU_DRIVER_RAW_COMMAND_QUEUE_H
+
+#include <flir_ptu_driver/io_engine.h>
+
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Sends raw command payloads from any number of threads. A payload is
+ * copied straight onto the port's lock-free transmit queue, see
+ * serial::Serial::enqueueWrite; one request on the I/O thread then writes
+ * out whatever has queued up and reads back the responses, so they do
+ * not end up in front of the poller's. Payloads should hold whole
+ * commands: the queue counts responses across payloads in the order they
+ * are pushed, which from several threads need not be the order written.
+ */
+class RawCommandQueue
+{
+public:
+  /** Receives the responses to one batch, concatenated. Called on the I/O
+   * thread. */
+  typedef std::function<void(const std::string&)> ResponseCallback;
+
+  RawCommandQueue(IOEngine* io, ResponseCallback callback);
+
+  /** Queues a payload for the next batch. The bytes are copied, so they
+   * need not outlive the call.
+   * \param data bytes to send
+   * \param length number of bytes
+   * \return false if there was no memory to queue the payload
+   */
+  bool push(const uint8_t* data, size_t length);
+
+private:
+  /** Runs on the I/O thread and sends everything queued so far. */
+  void flush(PTU& pantilt);
+
+  IOEngine* io_;
+  ResponseCallback callback_;
+
+  // Guards the response count and whether a flush is posted; payloads go
+  // onto the port's queue without it
+  std::mutex mutex_;
+  size_t expected_;
+  bool in_command_;
+  bool scheduled_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_RAW_COMMAND_QUEUE_H
@@ -0,0 +1,139 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_SIMULATOR_H
+#define FLIR_PTU_DRIVER_SIMULATOR_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flir_ptu_driver
+{
+
+/** Limits and dynamics of one simulated axis, in counts. */
+struct SimulatorAxis
+{
+  double resolution;   ///< arc-seconds per count, as reported by "pr"
+  long min, max;       ///< position limits
+  long speed_min, speed_max;  ///< speed limits, counts/second
+  long acceleration;   ///< counts/second^2
+  long base_speed;     ///< speed a move starts from, counts/second
+};
+
+/** Behaviour of a simulated unit. The defaults resemble a D46. */
+struct SimulatorOptions
+{
+  SimulatorOptions();
+
+  SimulatorAxis pan, tilt;
+  uint32_t baud;   ///< paces responses at ten bits a byte
+  double latency;  ///< seconds between a command and its response
+
+  /** If not empty, response i waits latencies[i % size] seconds instead
+   * of latency, or latency where that is negative. ptu_replay fills it
+   * from a recording, so a unit's field timing can be reproduced. */
+  std::vector<double> latencies;
+};
+
+/**
+ * A PTU on a pty, speaking the terse ASCII protocol the driver uses:
+ * position, speed, offset, limit, resolution, acceleration and base
+ * speed commands for each axis, control mode, slaved and immediate
+ * execution, await, halt, reset, limit enforcement and baud changes.
+ * Axes move with trapezoidal velocity profiles, so polled state and
+ * completion times look like a real unit's. Point the driver at port()
+ * to run it without hardware.
+ */
+class Simulator
+{
+public:
+  explicit Simulator(const SimulatorOptions& options = SimulatorOptions());
+  ~Simulator();
+
+  /** Opens the pty and starts serving it. \return false on failure */
+  bool start();
+
+  /** Stops serving and closes the pty. */
+  void stop();
+
+  /** \return path of the pty to open, once started */
+  const std::string& port() const { return port_; }
+
+  /** Current positions in counts. */
+  void getPosition(long* pan, long* tilt) const;
+
+private:
+  struct Axis
+  {
+    SimulatorAxis limits;
+    double position;   ///< counts
+    double velocity;   ///< counts/second
+    long target;       ///< position mode goal
+    long speed;        ///< position mode speed, or velocity mode goal
+    long staged_target;  ///< held by slaved mode until executed
+    bool staged;
+  };
+
+  struct Output
+  {
+    std::chrono::steady_clock::time_point due;
+    std::string data;
+  };
+
+  void run();
+  void step(double dt);
+  void stepAxis(Axis* axis, double dt);
+  bool moving() const;
+
+  void receive(const char* data, size_t length);
+  void execute(const std::string& command);
+  std::string executeAxis(Axis* axis, char op, bool has_value, long value);
+  void executeStaged();
+  void respond(const std::string& data);
+  void flushOutput();
+
+  SimulatorOptions options_;
+  std::string port_;
+  int master_fd_, slave_fd_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+
+  mutable std::mutex mutex_;
+  Axis pan_, tilt_;
+  char mode_;           ///< PTU_POSITION or PTU_VELOCITY
+  bool slaved_;
+  bool limits_enabled_;
+  uint32_t baud_;
+  std::string command_;  ///< received bytes short of a delimiter
+  std::deque<Output> output_;
+  size_t responses_;  ///< responded so far, indexing options_.latencies
+  std::deque<std::string> awaiting_;  ///< sent once motion stops
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_SIMULATOR_H
@@ -0,0 +1,113 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_TRAFFIC_RECORDER_H
+#define FLIR_PTU_DRIVER_TRAFFIC_RECORDER_H
+
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Records the bytes exchanged with a unit, timestamped, into a ring in a
+ * memory-mapped file, so that timing problems seen in the field can be
+ * replayed offline with ptu_replay. The file is sized when opened and
+ * never grows; once full, the oldest frames are overwritten. Recording a
+ * frame is a clock read and a copy into the mapping, with no system call
+ * and no allocation, and since the kernel owns the pages the recording
+ * survives the process crashing. Frames are recorded by one thread, the
+ * unit's I/O thread.
+ */
+class TrafficRecorder
+{
+public:
+  enum Direction
+  {
+    TX = 'T',   ///< written to the unit
+    RX = 'R',   ///< read from the unit
+    BAUD = 'B'  ///< the link's rate, in decimal, when it was set
+  };
+
+  /** One recorded write or read. */
+  struct Frame
+  {
+    uint64_t time_ns;  ///< since the recording was opened
+    Direction direction;
+    std::string data;
+  };
+
+  TrafficRecorder();
+  ~TrafficRecorder();
+
+  /**
+   * Creates or truncates a recording and maps it.
+   * \param path file to record to
+   * \param bytes size of the file; rounded down to whole slots
+   * \return false if the file could not be created, sized or mapped
+   */
+  bool open(const std::string& path, size_t bytes);
+
+  /** Unmaps the recording, leaving the file as it stands. */
+  void close();
+
+  bool isOpen() const
+  {
+    return header_ != NULL;
+  }
+
+  /** Records one frame. Does nothing unless open. */
+  void record(Direction direction, const char* data, size_t length);
+
+  void record(Direction direction, const std::string& data)
+  {
+    record(direction, data.data(), data.length());
+  }
+
+  /**
+   * Reads back a recording, oldest frame first. A frame partly
+   * overwritten by the ring wrapping around is left out.
+   * \param start_ns set to the wall clock time the recording was opened
+   * \return false if path is not a recording
+   */
+  static bool load(const std::string& path, std::vector<Frame>* frames, int64_t* start_ns = NULL);
+
+private:
+  // Disable copy constructors
+  TrafficRecorder(const TrafficRecorder&);
+  TrafficRecorder& operator=(const TrafficRecorder&);
+
+  struct Header;
+  struct Slot;
+
+  Header* header_;
+  Slot* slots_;
+  size_t mapped_;
+  uint64_t count_;  ///< slots written since opening
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_TRAFFIC_RECORDER_H
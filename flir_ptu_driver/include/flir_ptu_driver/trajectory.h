@@ -0,0 +1,69 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef FLIR_PTU_DRIVER_TRAJECTORY_H
+#define FLIR_PTU_DRIVER_TRAJECTORY_H
+
+#include <flir_ptu_driver/driver.h>
+
+#include <string>
+#include <vector>
+
+namespace flir_ptu_driver
+{
+
+/** A point to pass through, at a time relative to the trajectory start. */
+struct Waypoint
+{
+  double time;  ///< seconds from start
+  float pan;    ///< radians
+  float tilt;   ///< radians
+};
+
+/** The move to one waypoint, with its commands already formatted. */
+struct TrajectorySegment
+{
+  double start;  ///< seconds from start at which the move begins
+  double end;    ///< seconds from start at which the waypoint is due
+  float pan, tilt;
+  std::vector<std::string> commands;  ///< speeds then positions, for PTU::sendSlavedGroup
+};
+
+/**
+ * Works out the commands for a whole trajectory up front, so that while
+ * it runs each segment costs a single pipelined exchange. Speeds are
+ * chosen so that both axes arrive together at each waypoint's time, and
+ * are clamped to the unit's speed range.
+ * \param calibration the unit's resolution and limits, as PTU::calibration
+ *        gives them; a copy, so planning need not touch the live PTU
+ * \param limits_enabled whether waypoints must lie within the position limits
+ * \param pan current pan position in radians, where the first segment starts
+ * \param tilt current tilt position in radians
+ * \param waypoints points to pass through, in increasing time order
+ * \param segments filled with one segment per waypoint
+ * \return empty on success, otherwise why the trajectory was rejected
+ */
+std::string planTrajectory(const Calibration& calibration, bool limits_enabled, float pan, float tilt,
+                           const std::vector<Waypoint>& waypoints,
+                           std::vector<TrajectorySegment>* segments);
+
+}  // namespace flir_ptu_driver
+
+#endif  // FLIR_PTU_DRIVER_TRAJECTORY_H
@@ -0,0 +1,64 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/calibration_cache.h>
+
+namespace flir_ptu_driver
+{
+
+std::string CalibrationCache::identify(const std::string& port)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  serial::PortInfo info;
+  if (!ports_.findByPort(port, &info)) return "";
+
+  const std::string& id = info.hardware_id;
+  if (id.empty() || id == "n/a") return "";
+  if (id.find("SNR=") == std::string::npos) return id + " " + info.port;
+  return id;
+}
+
+std::string CalibrationCache::resolve(const std::string& name)
+{
+  if (name.empty() || name[0] == '/') return name;
+  std::lock_guard<std::mutex> lock(mutex_);
+  serial::PortInfo info;
+  if (!ports_.findByIdentity(name, &info)) return "";
+  return info.port;
+}
+
+bool CalibrationCache::find(const std::string& identity, Calibration* calibration) const
+{
+  if (identity.empty()) return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, Calibration>::const_iterator it = calibrations_.find(identity);
+  if (it == calibrations_.end()) return false;
+  *calibration = it->second;
+  return true;
+}
+
+void CalibrationCache::store(const std::string& identity, const Calibration& calibration)
+{
+  if (identity.empty()) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  calibrations_[identity] = calibration;
+}
+
+}  // namespace flir_ptu_driver
@@ -0,0 +1,185 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/command_coalescer.h>
+#include <ros/console.h>
+
+namespace flir_ptu_driver
+{
+
+CommandCoalescer::CommandCoalescer(IOEngine* io, PTUState* state)
+  : io_(io), state_(state), scheduled_(false), minimum_time_(false)
+{
+}
+
+void CommandCoalescer::setTarget(float pan, float tilt, float panspeed, float tiltspeed)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (pan_.absolute || pan_.offset || tilt_.absolute || tilt_.offset)
+  {
+    ROS_DEBUG_STREAM_NAMED("flir_node", "Dropping superseded PTU target");
+  }
+
+  pan_ = Pending();
+  pan_.absolute = true;
+  pan_.position = pan;
+  pan_.speed = panspeed;
+
+  tilt_ = Pending();
+  tilt_.absolute = true;
+  tilt_.position = tilt;
+  tilt_.speed = tiltspeed;
+
+  schedule();
+}
+
+void CommandCoalescer::addOffset(float pan, float tilt)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // An offset on top of a pending target simply moves the target; an
+  // offset on top of a pending offset accumulates. It cancels a velocity.
+  if (pan_.velocity)
+  {
+    pan_ = Pending();
+  }
+  if (tilt_.velocity)
+  {
+    tilt_ = Pending();
+  }
+
+  if (!pan_.absolute)
+  {
+    pan_.offset = true;
+  }
+  pan_.position += pan;
+
+  if (!tilt_.absolute)
+  {
+    tilt_.offset = true;
+  }
+  tilt_.position += tilt;
+
+  schedule();
+}
+
+void CommandCoalescer::setVelocity(float pan, float tilt)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  pan_ = Pending();
+  pan_.velocity = true;
+  pan_.speed = pan;
+
+  tilt_ = Pending();
+  tilt_.velocity = true;
+  tilt_.speed = tilt;
+
+  schedule();
+}
+
+void CommandCoalescer::schedule()
+{
+  if (scheduled_) return;
+  scheduled_ = true;
+
+  io_->post<void>(std::bind(&CommandCoalescer::flush, this, std::placeholders::_1));
+}
+
+void CommandCoalescer::flush(PTU& pantilt)
+{
+  Pending pan, tilt;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pan = pan_;
+    tilt = tilt_;
+    pan_ = Pending();
+    tilt_ = Pending();
+    scheduled_ = false;
+  }
+
+  if (pan.velocity || tilt.velocity)
+  {
+    if (state_)
+    {
+      state_->clearTargets();
+    }
+    if (pantilt.setMode(PTU_VELOCITY))
+    {
+      pantilt.setVelocity(PTU_PAN, pan.speed);
+      pantilt.setVelocity(PTU_TILT, tilt.speed);
+    }
+    return;
+  }
+
+  if ((pan.absolute || pan.offset || tilt.absolute || tilt.offset) &&
+      !pantilt.setMode(PTU_POSITION))
+  {
+    return;
+  }
+
+  if (pan.absolute && tilt.absolute)
+  {
+    // Both axes in one slaved group, so they start together
+    bool sent = minimum_time_ ?
+      pantilt.moveFastest(pan.position, tilt.position, pan.speed, tilt.speed) :
+      pantilt.setPositionAndSpeed(pan.position, tilt.position, pan.speed, tilt.speed);
+    if (sent && state_)
+    {
+      state_->setTarget(PTU_PAN, pan.position);
+      state_->setTarget(PTU_TILT, tilt.position);
+    }
+  }
+  else
+  {
+    if (pan.absolute && pantilt.setPosition(PTU_PAN, pan.position) && state_)
+    {
+      state_->setTarget(PTU_PAN, pan.position);
+    }
+    if (tilt.absolute && pantilt.setPosition(PTU_TILT, tilt.position) && state_)
+    {
+      state_->setTarget(PTU_TILT, tilt.position);
+    }
+    if (pan.absolute)
+    {
+      pantilt.setSpeed(PTU_PAN, pan.speed);
+    }
+    if (tilt.absolute)
+    {
+      pantilt.setSpeed(PTU_TILT, tilt.speed);
+    }
+  }
+
+  if (pan.offset || tilt.offset)
+  {
+    // Where a relative move ends depends on where it started
+    if (state_)
+    {
+      state_->clearTargets();
+    }
+    if (pantilt.offsetPosition(pan.offset ? pan.position : 0,
+                               tilt.offset ? tilt.position : 0))
+    {
+      ROS_DEBUG_STREAM_NAMED("flir_node", "PTU offset successfully");
+    }
+  }
+}
+
+}  // namespace flir_ptu_driver
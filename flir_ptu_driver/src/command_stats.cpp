@@ -0,0 +1,207 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/command_stats.h>
+
+#include <ctype.h>
+
+#include <algorithm>
+
+namespace flir_ptu_driver
+{
+
+CommandStats::CommandStats()
+{
+  for (size_t i = 0; i < MAX_MNEMONICS; i++)
+  {
+    Entry& entry = entries_[i];
+    entry.key = 0;
+    entry.count = entry.timeouts = entry.naks = 0;
+    entry.bytes_out = entry.bytes_in = 0;
+    for (size_t j = 0; j < BUCKETS; j++)
+    {
+      entry.buckets[j] = 0;
+    }
+  }
+}
+
+uint32_t CommandStats::key(const char* command, size_t length)
+{
+  size_t i = 0;
+  while (i < length && command[i] == ' ') i++;
+
+  // "@(baud,0,0)" counts as "@", axis commands as their two letters
+  uint32_t key = 0;
+  size_t letters = 0;
+  if (i < length && command[i] == '@')
+  {
+    key = '@';
+    letters = 1;
+    i = length;
+  }
+  while (i < length && letters < 2 && isalpha(static_cast<unsigned char>(command[i])))
+  {
+    key |= static_cast<uint32_t>(static_cast<unsigned char>(command[i])) << (8 * letters);
+    letters++;
+    i++;
+  }
+  if (letters == 0)
+  {
+    return '?';
+  }
+  if (i < length && command[i] != ' ' && command[i] != '\r' && command[i] != '\n')
+  {
+    key |= static_cast<uint32_t>('=') << (8 * letters);
+  }
+  return key;
+}
+
+CommandStats::Entry* CommandStats::find(uint32_t key)
+{
+  // Open addressing: an entry's key is claimed once and never changes
+  size_t start = (key * 2654435761u) % MAX_MNEMONICS;
+  for (size_t probe = 0; probe < MAX_MNEMONICS; probe++)
+  {
+    Entry& entry = entries_[(start + probe) % MAX_MNEMONICS];
+    uint32_t current = entry.key.load(std::memory_order_acquire);
+    if (current == 0)
+    {
+      uint32_t expected = 0;
+      if (entry.key.compare_exchange_strong(expected, key, std::memory_order_acq_rel))
+      {
+        return &entry;
+      }
+      current = expected;
+    }
+    if (current == key)
+    {
+      return &entry;
+    }
+  }
+  return NULL;
+}
+
+void CommandStats::record(const char* command, size_t length, uint64_t nanoseconds,
+                          size_t bytes_in, Outcome outcome)
+{
+  Entry* entry = find(key(command, length));
+  if (!entry) return;
+
+  entry->count.fetch_add(1, std::memory_order_relaxed);
+  entry->bytes_out.fetch_add(length, std::memory_order_relaxed);
+  entry->bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+  if (outcome == NAK)
+  {
+    entry->naks.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (outcome == TIMEOUT)
+  {
+    // How long we gave up after says nothing about the link
+    entry->timeouts.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  uint64_t microseconds = nanoseconds / 1000;
+  size_t bucket = 0;
+  while (bucket + 1 < BUCKETS && (microseconds >> (bucket + 1)) != 0)
+  {
+    bucket++;
+  }
+  entry->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+CommandStats::Outcome CommandStats::outcome(const std::string& response)
+{
+  if (response.empty() || response[response.length() - 1] != '\n') return TIMEOUT;
+  if (response[0] == '!') return NAK;
+  return ACK;
+}
+
+void CommandStats::snapshot(std::vector<Snapshot>* snapshots) const
+{
+  snapshots->clear();
+  for (size_t i = 0; i < MAX_MNEMONICS; i++)
+  {
+    const Entry& entry = entries_[i];
+    uint32_t key = entry.key.load(std::memory_order_acquire);
+    if (key == 0) continue;
+
+    Snapshot snapshot;
+    for (; key != 0; key >>= 8)
+    {
+      snapshot.mnemonic.push_back(static_cast<char>(key & 0xff));
+    }
+    snapshot.count = entry.count.load(std::memory_order_relaxed);
+    snapshot.timeouts = entry.timeouts.load(std::memory_order_relaxed);
+    snapshot.naks = entry.naks.load(std::memory_order_relaxed);
+    snapshot.bytes_out = entry.bytes_out.load(std::memory_order_relaxed);
+    snapshot.bytes_in = entry.bytes_in.load(std::memory_order_relaxed);
+    for (size_t j = 0; j < BUCKETS; j++)
+    {
+      snapshot.buckets[j] = entry.buckets[j].load(std::memory_order_relaxed);
+    }
+    snapshots->push_back(snapshot);
+  }
+
+  std::sort(snapshots->begin(), snapshots->end(),
+            [](const Snapshot& a, const Snapshot& b) { return a.mnemonic < b.mnemonic; });
+}
+
+void CommandStats::Snapshot::subtract(const Snapshot& earlier)
+{
+  count -= earlier.count;
+  timeouts -= earlier.timeouts;
+  naks -= earlier.naks;
+  bytes_out -= earlier.bytes_out;
+  bytes_in -= earlier.bytes_in;
+  for (size_t j = 0; j < BUCKETS; j++)
+  {
+    buckets[j] -= earlier.buckets[j];
+  }
+}
+
+double CommandStats::Snapshot::percentile(double q) const
+{
+  uint64_t total = 0;
+  for (size_t j = 0; j < BUCKETS; j++)
+  {
+    total += buckets[j];
+  }
+  if (total == 0) return 0;
+
+  // Interpolate within the bucket holding the q'th exchange
+  double target = q * total;
+  double below = 0;
+  for (size_t j = 0; j < BUCKETS; j++)
+  {
+    if (buckets[j] == 0) continue;
+    if (below + buckets[j] >= target || j + 1 == BUCKETS)
+    {
+      double lower = j == 0 ? 0 : static_cast<double>(1ULL << j);
+      double upper = static_cast<double>(1ULL << (j + 1));
+      double fraction = std::min(1.0, std::max(0.0, (target - below) / buckets[j]));
+      return (lower + fraction * (upper - lower)) * 1e-6;
+    }
+    below += buckets[j];
+  }
+  return 0;
+}
+
+}  // namespace flir_ptu_driver
@@ -28,42 +28,23 @@
  *
  */
 
-#include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string/trim.hpp>
 #include <flir_ptu_driver/driver.h>
+#include <flir_ptu_driver/protocol.h>
 #include <serial/serial.h>
 #include <ros/console.h>
 
+#include <algorithm>
+#include <chrono>
 #include <math.h>
+#include <unistd.h>
 #include <string>
 #include <sstream>
 #include <iostream>
 #include <vector>
 
-using boost::lexical_cast;
-
 namespace flir_ptu_driver
 {
 
-/** Templated wrapper function on lexical_cast to assist with extracting
- * values from serial response strings.
- */
-template<typename T>
-T parseResponse(std::string responseBuffer)
-{
-  std::string trimmed = responseBuffer.substr(1);
-  boost::trim(trimmed);
-
-  if (trimmed.empty())
-  {
-      trimmed = "0";
-  }
-
-  T parsed = lexical_cast<T>(trimmed);
-  ROS_DEBUG_STREAM("Parsed response value: " << parsed);
-  return parsed;
-}
-
 void PTU::setDryRun(bool is_dry_run)
 {
   is_dry_run_ = is_dry_run;
@@ -77,33 +58,58 @@ bool PTU::initialized()
 bool PTU::disableLimits()
 {
   ser_->write("ld ");  // Disable Limits
-  ser_->read(20);
+  trace(TrafficRecorder::TX, "ld ", 3);
+  trace(TrafficRecorder::RX, ser_->read(20));
   Lim = false;
   return true;
 }
 
-bool PTU::initialize()
+bool PTU::initialize(const Calibration* cached)
 {
   ser_->write("ft ");  // terse feedback
   ser_->write("ed ");  // disable echo
   ser_->write("ci ");  // position mode
-  ser_->read(20);
-
-  // get pan tilt encoder res
-  tr = getRes(PTU_TILT);
-  pr = getRes(PTU_PAN);
-
-  PMin = getLimit(PTU_PAN, PTU_MIN);
-  PMax = getLimit(PTU_PAN, PTU_MAX);
-  TMin = getLimit(PTU_TILT, PTU_MIN);
-  TMax = getLimit(PTU_TILT, PTU_MAX);
-  PSMin = getLimit(PTU_PAN, PTU_MIN_SPEED);
-  PSMax = getLimit(PTU_PAN, PTU_MAX_SPEED);
-  TSMin = getLimit(PTU_TILT, PTU_MIN_SPEED);
-  TSMax = getLimit(PTU_TILT, PTU_MAX_SPEED);
+  traceBaud();
+  trace(TrafficRecorder::TX, "ft ed ci ", 9);
+  trace(TrafficRecorder::RX, ser_->read(20));
+  forgetSettings();
+  ModeAcked = PTU_POSITION;
+
+  AxisState& pan = axes_[protocol::Pan::index];
+  AxisState& tilt = axes_[protocol::Tilt::index];
+
+  // get pan tilt encoder res; the pan resolution also confirms that the
+  // unit is answering, and that a cached calibration is still its own
+  pan.resolution = getRes(PTU_PAN);
+  if (cached && pan.resolution > 0 && pan.resolution == cached->pan_resolution)
+  {
+    tilt.resolution = cached->tilt_resolution;
+    pan.min = cached->pan_min;
+    pan.max = cached->pan_max;
+    tilt.min = cached->tilt_min;
+    tilt.max = cached->tilt_max;
+    pan.min_speed = cached->pan_speed_min;
+    pan.max_speed = cached->pan_speed_max;
+    tilt.min_speed = cached->tilt_speed_min;
+    tilt.max_speed = cached->tilt_speed_max;
+  }
+  else
+  {
+    tilt.resolution = getRes(PTU_TILT);
+
+    pan.min = getLimit(PTU_PAN, PTU_MIN);
+    pan.max = getLimit(PTU_PAN, PTU_MAX);
+    tilt.min = getLimit(PTU_TILT, PTU_MIN);
+    tilt.max = getLimit(PTU_TILT, PTU_MAX);
+    pan.min_speed = getLimit(PTU_PAN, PTU_MIN_SPEED);
+    pan.max_speed = getLimit(PTU_PAN, PTU_MAX_SPEED);
+    tilt.min_speed = getLimit(PTU_TILT, PTU_MIN_SPEED);
+    tilt.max_speed = getLimit(PTU_TILT, PTU_MAX_SPEED);
+  }
   Lim = true;
 
-  if (tr <= 0 || pr <= 0 || PMin == -1 || PMax == -1 || TMin == -1 || TMax == -1)
+  if (tilt.resolution <= 0 || pan.resolution <= 0 || pan.min == -1 || pan.max == -1 ||
+      tilt.min == -1 || tilt.max == -1)
   {
     initialized_ = false;
   }
@@ -115,57 +121,335 @@ bool PTU::initialize()
   return initialized();
 }
 
+Calibration PTU::calibration() const
+{
+  const AxisState& pan = axes_[protocol::Pan::index];
+  const AxisState& tilt = axes_[protocol::Tilt::index];
+  Calibration calibration;
+  calibration.pan_resolution = pan.resolution;
+  calibration.tilt_resolution = tilt.resolution;
+  calibration.pan_min = pan.min;
+  calibration.pan_max = pan.max;
+  calibration.tilt_min = tilt.min;
+  calibration.tilt_max = tilt.max;
+  calibration.pan_speed_min = pan.min_speed;
+  calibration.pan_speed_max = pan.max_speed;
+  calibration.tilt_speed_min = tilt.min_speed;
+  calibration.tilt_speed_max = tilt.max_speed;
+  return calibration;
+}
+
+// "@(baud,0,0) " sets the host port rate and leaves the others alone
+static size_t formatBaudCommand(char* out, uint32_t baud)
+{
+  size_t length = 0;
+  out[length++] = '@';
+  out[length++] = '(';
+  length += protocol::formatInt(out + length, baud);
+  for (const char* p = ",0,0) "; *p; p++)
+  {
+    out[length++] = *p;
+  }
+  out[length] = '\0';
+  return length;
+}
+
+uint32_t PTU::negotiateBaud(uint32_t max_baud)
+{
+  static const uint32_t rates[] = { 115200, 57600, 38400, 19200 };
+  uint32_t current = ser_->getBaudrate();
+
+  for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+  {
+    if (rates[i] > max_baud) continue;
+    if (rates[i] <= current) break;
+
+    if (switchBaud(rates[i]))
+    {
+      ROS_INFO_STREAM("FLIR PTU link now running at " << rates[i] << " baud.");
+      return rates[i];
+    }
+  }
+  return ser_->getBaudrate();
+}
+
+bool PTU::switchBaud(uint32_t baud)
+{
+  uint32_t previous = ser_->getBaudrate();
+
+  char command[protocol::MAX_COMMAND_LEN];
+  size_t length = formatBaudCommand(command, baud);
+  const std::string& buffer = query(command, length);
+  if (!protocol::isAck(buffer))
+  {
+    ROS_DEBUG_STREAM("PTU refused " << baud << " baud");
+    return false;
+  }
+
+  // The acknowledgement goes out at the old rate; let it drain before
+  // retuning the port.
+  ser_->flush();
+  usleep(100000);
+  ser_->setBaudrate(baud);
+  ser_->flushInput();
+  traceBaud();
+
+  if (protocol::hasValue(query("pr ", 3)))
+  {
+    return true;
+  }
+
+  // The unit may or may not have switched; ask it to go back from the new
+  // rate, then listen at the old one.
+  ROS_WARN_STREAM("No response from PTU at " << baud << " baud, reverting to " << previous);
+  length = formatBaudCommand(command, previous);
+  query(command, length);
+  ser_->flush();
+  usleep(100000);
+  ser_->setBaudrate(previous);
+  ser_->flushInput();
+  traceBaud();
+  return false;
+}
+
 std::string PTU::sendCommand(std::string command)
 {
-  ser_->write(command);
-  ROS_DEBUG_STREAM("TX: " << command);
-  std::string buffer = ser_->readline(PTU_BUFFER_LEN);
-  ROS_DEBUG_STREAM("RX: " << buffer);
-  return buffer;
+  return query(command.data(), command.length());
+}
+
+const std::string& PTU::query(const char* command, size_t length)
+{
+  std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+  ser_->write(reinterpret_cast<const uint8_t*>(command), length);
+  trace(TrafficRecorder::TX, command, length);
+  ROS_DEBUG_STREAM("TX: " << std::string(command, length));
+  rx_.clear();  // Keeps its capacity, so steady state reads don't allocate
+  ser_->readline(rx_, PTU_BUFFER_LEN);
+  trace(TrafficRecorder::RX, rx_);
+  ROS_DEBUG_STREAM("RX: " << rx_);
+  record(command, length, sent, rx_);
+  return rx_;
+}
+
+void PTU::record(const char* command, size_t length,
+                 std::chrono::steady_clock::time_point sent, const std::string& response)
+{
+  uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - sent).count();
+  stats_.record(command, length, nanoseconds, response.length(), CommandStats::outcome(response));
+}
+
+void PTU::traceBaud()
+{
+  if (!recorder_) return;
+  char baud[protocol::MAX_COMMAND_LEN];
+  trace(TrafficRecorder::BAUD, baud, protocol::formatInt(baud, ser_->getBaudrate()));
+}
+
+std::vector<std::string> PTU::sendCommands(const std::vector<std::string>& commands)
+{
+  std::vector<serial::WriteBuffer> buffers(commands.size());
+  for (size_t i = 0; i < commands.size(); i++)
+  {
+    buffers[i].data = reinterpret_cast<const uint8_t*>(commands[i].data());
+    buffers[i].size = commands[i].length();
+    ROS_DEBUG_STREAM("TX: " << commands[i]);
+  }
+
+  // One system call for the lot, without joining them first
+  std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+  ser_->writev(buffers.empty() ? NULL : &buffers[0], buffers.size());
+  for (size_t i = 0; i < commands.size(); i++)
+  {
+    trace(TrafficRecorder::TX, commands[i]);
+  }
+
+  std::vector<std::string> responses(commands.size());
+  for (size_t i = 0; i < commands.size(); i++)
+  {
+    responses[i] = ser_->readline(PTU_BUFFER_LEN);
+    trace(TrafficRecorder::RX, responses[i]);
+    ROS_DEBUG_STREAM("RX: " << responses[i]);
+    record(commands[i].data(), commands[i].length(), sent, responses[i]);
+    if (responses[i].empty())
+    {
+      // A missing response leaves the rest of the pipeline out of step;
+      // discard whatever else arrives so the next exchange starts clean.
+      ser_->flushInput();
+      break;
+    }
+  }
+  return responses;
 }
 
+bool PTU::awaitCompletion(double timeout)
+{
+  if (!initialized()) return false;
+
+  // The unit holds its response to "a" until motion has finished, so keep
+  // reading past the port's own timeout rather than re-querying.
+  std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+  ser_->write("a ");
+  trace(TrafficRecorder::TX, "a ", 2);
+  ROS_DEBUG_STREAM("TX: a ");
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+
+  rx_.clear();
+  while (rx_.empty() || rx_[rx_.length() - 1] != '\n')
+  {
+    if (std::chrono::steady_clock::now() >= deadline)
+    {
+      ROS_WARN("PTU motion did not complete before timeout.");
+      trace(TrafficRecorder::RX, rx_);
+      record("a ", 2, sent, rx_);
+      // The late acknowledgement would be taken as the next response
+      ser_->flushInput();
+      return false;
+    }
+    ser_->readline(rx_, PTU_BUFFER_LEN);
+  }
+  trace(TrafficRecorder::RX, rx_);
+  ROS_DEBUG_STREAM("RX: " << rx_);
+  record("a ", 2, sent, rx_);
+  return protocol::isAck(rx_);
+}
 
 void PTU::sendCommand(const unsigned char * data, unsigned int length)
 {
   ser_->write(data, length);
+  trace(TrafficRecorder::TX, reinterpret_cast<const char*>(data), length);
   ROS_DEBUG_STREAM("TX: " << length << " bytes");
   return;
 }
 
-/* 
- * ===  FUNCTION  ======================================================================
- *         Name:  PTU::sendSlavedCommand
- *  Description:  send multiple commands slaved together. Stop if the return result is
- *   a NAK "!"
- *        Param:  string commands
- *        Param:  bool do_wait wait for completion, or enter "instantaneous"
- *       return:  std::string indicating the final result
- * =====================================================================================
- */
-std::string PTU::sendSlavedCommands (std::string commands, bool do_wait )
-{
-  // build the appropriate string stream for the problem
-  std::string s, result = "*", buffer="s,";
-  buffer.append(commands);
-  if (do_wait) buffer.append(",a");
-  else buffer.append(",I");
-  std::istringstream f(buffer);
-  
-  // iterate the list and fail gracefull where necessary
-  while (std::getline(f, s, ',') && result[0] =='*') {
-    result = sendCommand(s+" ");
+std::string PTU::sendQueuedCommands(size_t count)
+{
+  forgetSettings();
+  ModeAcked = PTU_MODE_UNKNOWN;
+
+  // Only copy out what was written when there is somewhere to record it
+  tx_.clear();
+  size_t total = ser_->flushWrites(recorder_ ? &tx_ : NULL);
+  if (!tx_.empty()) trace(TrafficRecorder::TX, tx_);
+  ROS_DEBUG_STREAM("TX: " << total << " queued bytes");
+
+  std::string responses;
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t length = ser_->readline(responses, PTU_BUFFER_LEN);
+    trace(TrafficRecorder::RX, responses.data() + responses.length() - length, length);
+    if (length == 0 || responses[responses.length() - 1] != '\n')
+    {
+      ROS_WARN_THROTTLE(30, "Missing response to raw PTU command");
+      ser_->flushInput();
+      break;
+    }
   }
-  
-  return result;
-}		/* -----  end of function PTU::sendSlavedCommands ----- */
+  ROS_DEBUG_STREAM("RX: " << responses);
+  return responses;
+}
+
+std::string PTU::sendSlaved(const std::vector<std::string>& commands)
+{
+  std::vector<std::string> group;
+  group.reserve(commands.size() + 1);
+  group.push_back("s ");
+  group.insert(group.end(), commands.begin(), commands.end());
+
+  // "I" goes out only once the whole group is known to be staged, so a
+  // refused command cannot leave the rest of the group to run
+  std::vector<std::string> responses = sendCommands(group);
+  for (size_t i = 0; i < group.size(); i++)
+  {
+    if (i >= responses.size() || !protocol::isAck(responses[i]))
+    {
+      ROS_ERROR_STREAM("Error sending slaved command " << group[i]);
+      abandonSlaved();
+      return i < responses.size() ? responses[i] : std::string();
+    }
+  }
+  return query("I ", 2);
+}
+
+void PTU::abandonSlaved()
+{
+  // Staging each axis where it is replaces whatever of the group was
+  // staged, so running that stops the axes rather than moving them
+  std::vector<std::string> group;
+  char command[protocol::MAX_COMMAND_LEN];
+  long count;
+  const std::string& pan = query(protocol::Query<protocol::Pan, 'p'>::text,
+                                 protocol::Query<protocol::Pan, 'p'>::length);
+  if (protocol::hasValue(pan) && protocol::parseInt(pan, &count))
+  {
+    group.push_back(std::string(command, protocol::formatCommand<protocol::Pan, 'p'>(command, count)));
+  }
+  const std::string& tilt = query(protocol::Query<protocol::Tilt, 'p'>::text,
+                                  protocol::Query<protocol::Tilt, 'p'>::length);
+  if (protocol::hasValue(tilt) && protocol::parseInt(tilt, &count))
+  {
+    group.push_back(std::string(command, protocol::formatCommand<protocol::Tilt, 'p'>(command, count)));
+  }
+  group.push_back("I ");
+  sendCommands(group);
+}
+
+std::string PTU::sendSlavedCommands (std::string commands, bool do_wait)
+{
+  std::vector<std::string> group;
+  std::istringstream f(commands);
+  std::string s;
+  while (std::getline(f, s, ','))
+  {
+    group.push_back(s + " ");
+  }
+
+  std::string result = sendSlaved(group);
+  if (!protocol::isAck(result))
+  {
+    return result;
+  }
+  // Waiting is done by awaitCompletion, which allows for the long reply
+  if (do_wait && !awaitCompletion())
+  {
+    return "!";
+  }
+  return "*";
+}
+
+bool PTU::sendSlavedGroup(const std::vector<std::string>& commands)
+{
+  if (!initialized()) return false;
+
+  // The group may carry speed commands of its own
+  forgetSpeeds();
+
+  return protocol::isAck(sendSlaved(commands));
+}
+
+bool PTU::halt()
+{
+  if (!initialized()) return false;
+
+  if (!protocol::isAck(query("h ", 2)))
+  {
+    ROS_ERROR("Error halting pan-tilt");
+    return false;
+  }
+  return true;
+}
 
 bool PTU::home()
 {
   ROS_INFO("Sending command to reset PTU.");
 
-  // Issue reset command
+  // Issue reset command; the unit comes back with its default ramps
+  forgetSettings();
+  ModeAcked = PTU_MODE_UNKNOWN;
   ser_->flush();
   ser_->write(" r ");
+  trace(TrafficRecorder::TX, " r ", 3);
 
   std::string actual_response, expected_response("!T!T!P!P*");
 
@@ -178,6 +462,7 @@ bool PTU::home()
     {
       ROS_INFO("PTU reset command response received.");
       ser_->read(actual_response, expected_response.length());
+      trace(TrafficRecorder::RX, actual_response);
       return (actual_response == expected_response);
     }
   }
@@ -191,15 +476,16 @@ float PTU::getRes(char type)
 {
   if (!ser_ || !ser_->isOpen()) return -1;
 
-  std::string buffer = sendCommand(std::string() + type + "r ");
+  const char command[] = { type, 'r', ' ' };
+  const std::string& buffer = query(command, sizeof(command));
 
-  if (buffer.length() < 3 || buffer[0] != '*')
+  double z;
+  if (!protocol::hasValue(buffer) || !protocol::parseDouble(buffer, &z))
   {
     ROS_ERROR_THROTTLE(30,"Error getting pan-tilt res");
     return -1;
   }
 
-  double z = parseResponse<double>(buffer);
   z = z / 3600;  // degrees/count
   return z * M_PI / 180;  // radians/count
 }
@@ -209,15 +495,17 @@ int PTU::getLimit(char type, char limType)
 {
   if (!ser_ || !ser_->isOpen()) return -1;
 
-  std::string buffer = sendCommand(std::string() + type + limType + " ");
+  const char command[] = { type, limType, ' ' };
+  const std::string& buffer = query(command, sizeof(command));
 
-  if (buffer.length() < 3 || buffer[0] != '*')
+  long limit;
+  if (!protocol::hasValue(buffer) || !protocol::parseInt(buffer, &limit))
   {
     ROS_ERROR_THROTTLE(30,"Error getting pan-tilt limit");
     return -1;
   }
 
-  return parseResponse<int>(buffer);
+  return limit;
 }
 
 
@@ -226,15 +514,17 @@ float PTU::getPosition(char type)
 {
   if (!initialized()) return -1;
 
-  std::string buffer = sendCommand(std::string() + type + "p ");
+  const char command[] = { type, 'p', ' ' };
+  const std::string& buffer = query(command, sizeof(command));
 
-  if (buffer.length() < 3 || buffer[0] != '*')
+  long count;
+  if (!protocol::hasValue(buffer) || !protocol::parseInt(buffer, &count))
   {
     ROS_ERROR_THROTTLE(30,"Error getting pan-tilt pos");
     return -1;
   }
 
-  return parseResponse<double>(buffer) * getResolution(type);
+  return count * getResolution(type);
 }
 
 
@@ -249,18 +539,19 @@ bool PTU::setPosition(char type, float pos, bool block)
   // Check limits
   if (Lim)
   {
-    if (count < (type == PTU_TILT ? TMin : PMin) || count > (type == PTU_TILT ? TMax : PMax))
+    const AxisState& limits = axis(type);
+    if (count < limits.min || count > limits.max)
     {
       ROS_ERROR_THROTTLE(30,"Pan Tilt Value out of Range: %c %f(%d) (%d-%d)\n",
-                type, pos, count, (type == PTU_TILT ? TMin : PMin), (type == PTU_TILT ? TMax : PMax));
+                type, pos, count, limits.min, limits.max);
       return false;
     }
   }
 
-  std::string buffer = sendCommand(std::string() + type + "p" +
-                                   lexical_cast<std::string>(count) + " ");
+  char command[protocol::MAX_COMMAND_LEN];
+  size_t length = protocol::formatCommand(command, type, 'p', count);
 
-  if (buffer.empty() || buffer[0] != '*')
+  if (!protocol::isAck(query(command, length)))
   {
     ROS_ERROR("Error setting pan-tilt pos");
     return false;
@@ -268,15 +559,75 @@ bool PTU::setPosition(char type, float pos, bool block)
 
   if (block)
   {
-    while (getPosition(type) != pos)
-    {
-      usleep(1000);
-    }
+    return awaitCompletion();
   }
 
   return true;
 }
 
+bool PTU::setPositionAndSpeed(float pan, float tilt, float panspeed, float tiltspeed, bool block)
+{
+  if (!initialized()) return false;
+
+  AxisState& p = axes_[protocol::Pan::index];
+  AxisState& t = axes_[protocol::Tilt::index];
+  int pancount = static_cast<int>(pan / p.resolution);
+  int tiltcount = static_cast<int>(tilt / t.resolution);
+  if (Lim && (pancount < p.min || pancount > p.max || tiltcount < t.min || tiltcount > t.max))
+  {
+    ROS_ERROR_THROTTLE(30, "Pan Tilt Value out of Range: %f(%d) %f(%d) (%d-%d, %d-%d)\n",
+                       pan, pancount, tilt, tiltcount, p.min, p.max, t.min, t.max);
+    return false;
+  }
+
+  char command[protocol::MAX_COMMAND_LEN];
+  std::vector<std::string> group;
+  group.reserve(4);
+
+  // Speeds first, so the positions are reached at the new speeds
+  int pan_speed = static_cast<int>(panspeed / p.resolution);
+  int tilt_speed = static_cast<int>(tiltspeed / t.resolution);
+  bool send_pan_speed = false, send_tilt_speed = false;
+  if (abs(pan_speed) < p.min_speed || abs(pan_speed) > p.max_speed)
+  {
+    ROS_ERROR("Pan Tilt Speed Value out of Range: %c %f(%d) (%d-%d)\n",
+              PTU_PAN, panspeed, pan_speed, p.min_speed, p.max_speed);
+  }
+  else if (pan_speed != p.speed_acked)
+  {
+    group.push_back(std::string(command, protocol::formatCommand<protocol::Pan, 's'>(command, pan_speed)));
+    send_pan_speed = true;
+  }
+  if (abs(tilt_speed) < t.min_speed || abs(tilt_speed) > t.max_speed)
+  {
+    ROS_ERROR("Pan Tilt Speed Value out of Range: %c %f(%d) (%d-%d)\n",
+              PTU_TILT, tiltspeed, tilt_speed, t.min_speed, t.max_speed);
+  }
+  else if (tilt_speed != t.speed_acked)
+  {
+    group.push_back(std::string(command, protocol::formatCommand<protocol::Tilt, 's'>(command, tilt_speed)));
+    send_tilt_speed = true;
+  }
+
+  group.push_back(std::string(command, protocol::formatCommand<protocol::Pan, 'p'>(command, pancount)));
+  group.push_back(std::string(command, protocol::formatCommand<protocol::Tilt, 'p'>(command, tiltcount)));
+
+  if (!protocol::isAck(sendSlaved(group)))
+  {
+    ROS_ERROR("Error setting pan-tilt position and speed");
+    forgetSpeeds();
+    return false;
+  }
+  if (send_pan_speed) p.speed_acked = pan_speed;
+  if (send_tilt_speed) t.speed_acked = tilt_speed;
+
+  if (block)
+  {
+    return awaitCompletion();
+  }
+  return true;
+}
+
 // send a pan or tilt offset
 bool PTU::offsetPosition(char type, float pos, bool block)
 {
@@ -285,10 +636,10 @@ bool PTU::offsetPosition(char type, float pos, bool block)
   // get raw encoder count to move
   int count = static_cast<int>(pos / getResolution(type));
 
-  std::string buffer = sendCommand(std::string() + type +"o" 
-    + lexical_cast<std::string>(count));
+  char command[protocol::MAX_COMMAND_LEN];
+  size_t length = protocol::formatCommand(command, type, 'o', count);
 
-  if (buffer.empty() || buffer[0] != '*')
+  if (!protocol::isAck(query(command, length)))
   {
     ROS_ERROR_STREAM("Error offsetting pan-tilt position "<<type<<pos);
     return false;
@@ -296,8 +647,7 @@ bool PTU::offsetPosition(char type, float pos, bool block)
 
   if (block)
   {
-    buffer = sendCommand(std::string() + "a");
-    if (buffer.empty() || buffer[0] != '*') 
+    if (!awaitCompletion())
     {
       ROS_ERROR_STREAM("Error offsetting pan-tilt position "<<type<<pos);
       return false;
@@ -313,13 +663,15 @@ bool PTU::offsetPosition(float x, float y, bool block)
   if (!initialized()) return false;
   
   // get raw encoder count to move
-  int pancount = static_cast<int>(x / getResolution('p'));
-  int tiltcount = static_cast<int>(y / getResolution('t'));
+  int pancount = static_cast<int>(x / getResolution<protocol::Pan>());
+  int tiltcount = static_cast<int>(y / getResolution<protocol::Tilt>());
+
+  char command[protocol::MAX_COMMAND_LEN];
+  std::string buffer;
+  buffer.append(command, protocol::formatCommand<protocol::Pan, 'o'>(command, pancount) - 1);
+  buffer += ",";
+  buffer.append(command, protocol::formatCommand<protocol::Tilt, 'o'>(command, tiltcount) - 1);
 
-  std::string buffer = std::string();
-  buffer += "po" + lexical_cast<std::string>(pancount) + ",";
-  buffer += "to" + lexical_cast<std::string>(tiltcount);
-  
   std::string result = sendSlavedCommands(buffer, block);
 
   if (result.empty() || result[0] != '*')
@@ -336,17 +688,198 @@ float PTU::getSpeed(char type)
 {
   if (!initialized()) return -1;
 
-  std::string buffer = sendCommand(std::string() + type + "s ");
+  const char command[] = { type, 's', ' ' };
+  const std::string& buffer = query(command, sizeof(command));
 
-  if (buffer.length() < 3 || buffer[0] != '*')
+  long count;
+  if (!protocol::hasValue(buffer) || !protocol::parseInt(buffer, &count))
   {
     ROS_ERROR("Error getting pan-tilt speed");
     return -1;
   }
 
-  return parseResponse<double>(buffer) * getResolution(type);
+  return count * getResolution(type);
+}
+
+
+int PTU::getSetting(char type, char op, int* cached)
+{
+  if (*cached != PTU_SPEED_UNKNOWN) return *cached;
+
+  const char command[] = { type, op, ' ' };
+  const std::string& buffer = query(command, sizeof(command));
+
+  long count;
+  if (!protocol::hasValue(buffer) || !protocol::parseInt(buffer, &count))
+  {
+    ROS_ERROR("Error getting pan-tilt %c%c", type, op);
+    return PTU_SPEED_UNKNOWN;
+  }
+  *cached = count;
+  return *cached;
+}
+
+bool PTU::setSetting(char type, char op, int count, int* cached)
+{
+  if (count == *cached)
+  {
+    return true;
+  }
+
+  char command[protocol::MAX_COMMAND_LEN];
+  size_t length = protocol::formatCommand(command, type, op, count);
+  if (!protocol::isAck(query(command, length)))
+  {
+    ROS_ERROR("Error setting pan-tilt %c%c to %d", type, op, count);
+    *cached = PTU_SPEED_UNKNOWN;
+    return false;
+  }
+  *cached = count;
+  return true;
 }
 
+float PTU::getAcceleration(char type)
+{
+  if (!initialized()) return -1;
+  int count = getSetting(type, PTU_ACCELERATION, &axis(type).acceleration);
+  return count == PTU_SPEED_UNKNOWN ? -1 : count * getResolution(type);
+}
+
+bool PTU::setAcceleration(char type, float acceleration)
+{
+  if (!initialized()) return false;
+
+  int count = static_cast<int>(acceleration / getResolution(type));
+  if (count <= 0)
+  {
+    ROS_ERROR("Pan Tilt Acceleration Value out of Range: %c %f(%d)\n", type, acceleration, count);
+    return false;
+  }
+  return setSetting(type, PTU_ACCELERATION, count, &axis(type).acceleration);
+}
+
+float PTU::getBaseSpeed(char type)
+{
+  if (!initialized()) return -1;
+  int count = getSetting(type, PTU_BASE_SPEED, &axis(type).base_speed);
+  return count == PTU_SPEED_UNKNOWN ? -1 : count * getResolution(type);
+}
+
+bool PTU::setBaseSpeed(char type, float speed)
+{
+  if (!initialized()) return false;
+
+  int count = static_cast<int>(speed / getResolution(type));
+  int max = axis(type).max_speed;
+  if (count < 0 || count > max)
+  {
+    ROS_ERROR("Pan Tilt Base Speed Value out of Range: %c %f(%d) (0-%d)\n", type, speed, count, max);
+    return false;
+  }
+  return setSetting(type, PTU_BASE_SPEED, count, &axis(type).base_speed);
+}
+
+bool PTU::getProfile(char type, AxisProfile* profile)
+{
+  float acceleration = getAcceleration(type);
+  float base_speed = getBaseSpeed(type);
+  if (acceleration < 0 || base_speed < 0) return false;
+
+  profile->acceleration = acceleration;
+  profile->base_speed = base_speed;
+  profile->min_speed = getMinSpeed(type);
+  profile->max_speed = getMaxSpeed(type);
+  return true;
+}
+
+bool PTU::moveFastest(float pan, float tilt, float pan_max_speed, float tilt_max_speed, bool block)
+{
+  if (!initialized()) return false;
+
+  AxisProfile profiles[2];
+  float from[2], speed[2];
+  if (!getProfile(PTU_PAN, &profiles[0]) || !getProfile(PTU_TILT, &profiles[1]) ||
+      !getState(&from[0], &from[1], &speed[0], &speed[1]))
+  {
+    return false;
+  }
+  float caps[2] = { pan_max_speed, tilt_max_speed };
+  for (size_t i = 0; i < 2; i++)
+  {
+    if (caps[i] > 0)
+    {
+      profiles[i].max_speed = std::max(std::min<double>(profiles[i].max_speed, caps[i]),
+                                       profiles[i].min_speed);
+    }
+  }
+
+  MovePlan plan = planMove(profiles[0], profiles[1], pan - from[0], tilt - from[1]);
+
+  // Speeds go out in whole counts; the nearest, plus half a count so
+  // that the conversion back does not truncate below it
+  double pan_res = getResolution<protocol::Pan>(), tilt_res = getResolution<protocol::Tilt>();
+  double panspeed = (lround(plan.pan_speed / pan_res) + 0.5) * pan_res;
+  double tiltspeed = (lround(plan.tilt_speed / tilt_res) + 0.5) * tilt_res;
+  ROS_DEBUG_STREAM("PTU move to " << pan << ", " << tilt << " planned to take " << plan.duration << "s");
+  return setPositionAndSpeed(pan, tilt, panspeed, tiltspeed, block);
+}
+
+// get pan/tilt position and speed with a single pipelined exchange
+bool PTU::getState(float* pan, float* tilt, float* panspeed, float* tiltspeed,
+                   StateStamps* stamps)
+{
+  if (!initialized()) return false;
+
+  static const char queries[] = "pp tp ps ts ";
+  std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+  ser_->write(reinterpret_cast<const uint8_t*>(queries), sizeof(queries) - 1);
+  trace(TrafficRecorder::TX, queries, sizeof(queries) - 1);
+  ROS_DEBUG_STREAM("TX: " << queries);
+
+  // Every reply is read before any is judged, so a refused query does not
+  // leave the ones after it waiting for the next exchange
+  long counts[4];
+  uint64_t arrivals[4];
+  bool valid = true;
+  for (size_t i = 0; i < 4; i++)
+  {
+    rx_.clear();
+    ser_->readline(rx_, PTU_BUFFER_LEN);
+    arrivals[i] = ser_->getReadTimestamp();
+    trace(TrafficRecorder::RX, rx_);
+    ROS_DEBUG_STREAM("RX: " << rx_);
+    record(queries + 3 * i, 3, sent, rx_);
+    if (rx_.empty())
+    {
+      // Past a timeout the rest would only time out too
+      valid = false;
+      break;
+    }
+    if (!protocol::hasValue(rx_) || !protocol::parseInt(rx_, &counts[i])) valid = false;
+  }
+
+  if (!valid)
+  {
+    // A missing or garbled reply may leave the pipeline out of step;
+    // discard whatever else arrives so the next exchange starts clean.
+    ser_->flushInput();
+    ROS_ERROR_THROTTLE(30, "Error getting pan-tilt state");
+    return false;
+  }
+
+  *pan = counts[0] * getResolution<protocol::Pan>();
+  *tilt = counts[1] * getResolution<protocol::Tilt>();
+  *panspeed = counts[2] * getResolution<protocol::Pan>();
+  *tiltspeed = counts[3] * getResolution<protocol::Tilt>();
+  if (stamps)
+  {
+    stamps->pan = arrivals[0];
+    stamps->tilt = arrivals[1];
+    stamps->panspeed = arrivals[2];
+    stamps->tiltspeed = arrivals[3];
+  }
+  return true;
+}
 
 
 // set speed in radians/sec
@@ -358,22 +891,72 @@ bool PTU::setSpeed(char type, float pos)
   int count = static_cast<int>(pos / getResolution(type));
 
   // Check limits
-  if (abs(count) < (type == PTU_TILT ? TSMin : PSMin) || abs(count) > (type == PTU_TILT ? TSMax : PSMax))
+  AxisState& state = axis(type);
+  if (abs(count) < state.min_speed || abs(count) > state.max_speed)
   {
     ROS_ERROR("Pan Tilt Speed Value out of Range: %c %f(%d) (%d-%d)\n",
-              type, pos, count, (type == PTU_TILT ? TSMin : PSMin), (type == PTU_TILT ? TSMax : PSMax));
+              type, pos, count, state.min_speed, state.max_speed);
     return false;
   }
 
-  std::string buffer = sendCommand(std::string() + type + "s" +
-                                   lexical_cast<std::string>(count) + " ");
+  int& acked = state.speed_acked;
+  if (count == acked)
+  {
+    return true;
+  }
+
+  char command[protocol::MAX_COMMAND_LEN];
+  size_t length = protocol::formatCommand(command, type, 's', count);
 
-  if (buffer.empty() || buffer[0] != '*')
+  if (!protocol::isAck(query(command, length)))
   {
     ROS_ERROR("Error setting pan-tilt speed\n");
+    acked = PTU_SPEED_UNKNOWN;
+    return false;
+  }
+
+  acked = count;
+  return true;
+}
+
+
+// set signed velocity in radians/sec, for velocity mode
+bool PTU::setVelocity(char type, float speed)
+{
+  if (!initialized()) return false;
+
+  int count = static_cast<int>(speed / getResolution(type));
+  AxisState& state = axis(type);
+  int min_count = state.min_speed;
+  int max_count = state.max_speed;
+
+  // Too slow to move at all is a stop; too fast is the fastest it can go
+  if (abs(count) < min_count)
+  {
+    count = 0;
+  }
+  else if (abs(count) > max_count)
+  {
+    count = count > 0 ? max_count : -max_count;
+  }
+
+  int& acked = state.speed_acked;
+  if (count == acked)
+  {
+    return true;
+  }
+
+  char command[protocol::MAX_COMMAND_LEN];
+  size_t length = protocol::formatCommand(command, type, 's', count);
+
+  if (!protocol::isAck(query(command, length)))
+  {
+    ROS_ERROR("Error setting pan-tilt velocity");
+    acked = PTU_SPEED_UNKNOWN;
     return false;
   }
 
+  acked = count;
   return true;
 }
 
@@ -383,14 +966,23 @@ bool PTU::setMode(char type)
 {
   if (!initialized()) return false;
 
-  std::string buffer = sendCommand(std::string("c") + type + " ");
+  if (type == ModeAcked)
+  {
+    return true;
+  }
+
+  const char command[] = { 'c', type, ' ' };
+  bool acked = protocol::isAck(query(command, sizeof(command)));
+  forgetSpeeds();
 
-  if (buffer.empty() || buffer[0] != '*')
+  if (!acked)
   {
     ROS_ERROR("Error setting pan-tilt move mode");
+    ModeAcked = PTU_MODE_UNKNOWN;
     return false;
   }
 
+  ModeAcked = type;
   return true;
 }
 
@@ -398,22 +990,24 @@ bool PTU::setMode(char type)
 char PTU::getMode()
 {
   if (!initialized()) return -1;
+  if (ModeAcked != PTU_MODE_UNKNOWN) return ModeAcked;
 
   // get pan tilt mode
-  std::string buffer = sendCommand("c ");
+  const std::string& buffer = query("c ", 2);
 
-  if (buffer.length() < 3 || buffer[0] != '*')
+  if (!protocol::hasValue(buffer))
   {
     ROS_ERROR("Error getting pan-tilt pos");
     return -1;
   }
 
   if (buffer[2] == 'p')
-    return PTU_VELOCITY;
+    ModeAcked = PTU_VELOCITY;
   else if (buffer[2] == 'i')
-    return PTU_POSITION;
+    ModeAcked = PTU_POSITION;
   else
     return -1;
+  return ModeAcked;
 }
 
 }  // namespace flir_ptu_driver
@@ -0,0 +1,79 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/io_engine.h>
+
+#include <utility>
+
+namespace flir_ptu_driver
+{
+
+IOEngine::IOEngine()
+  : ptu_(&ser_), stopping_(false), link_lost_(false)
+{
+  // Every exchange runs here, so reads need not lock against each other
+  ser_.setSingleReader(true);
+  thread_ = std::thread(&IOEngine::run, this);
+}
+
+IOEngine::~IOEngine()
+{
+  stop();
+}
+
+void IOEngine::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    commands_.clear();
+    polls_.clear();
+  }
+  ready_.notify_one();
+  if (thread_.joinable()) thread_.join();
+}
+
+void IOEngine::enqueue(std::function<void()> task, Priority priority)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    (priority == COMMAND ? commands_ : polls_).push_back(std::move(task));
+  }
+  ready_.notify_one();
+}
+
+void IOEngine::run()
+{
+  while (true)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return stopping_ || !commands_.empty() || !polls_.empty(); });
+      if (stopping_) return;
+      std::deque<std::function<void()> >& queue = commands_.empty() ? polls_ : commands_;
+      task = std::move(queue.front());
+      queue.pop_front();
+    }
+    task();
+  }
+}
+
+}  // namespace flir_ptu_driver
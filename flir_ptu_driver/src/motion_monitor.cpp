@@ -0,0 +1,91 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/motion_monitor.h>
+
+#include <math.h>
+
+namespace flir_ptu_driver
+{
+
+MotionMonitor::~MotionMonitor()
+{
+  cancel();
+}
+
+std::future<bool> MotionMonitor::watch(float pan, float tilt, float tolerance, double timeout)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::list<Watch>::iterator it = watches_.begin(); it != watches_.end(); ++it)
+  {
+    it->done.set_value(false);
+  }
+  watches_.clear();
+
+  watches_.push_back(Watch());
+  Watch& watch = watches_.back();
+  watch.pan = pan;
+  watch.tilt = tilt;
+  watch.tolerance = tolerance;
+  watch.deadline = PTUState::Clock::now() +
+    std::chrono::duration_cast<PTUState::Clock::duration>(std::chrono::duration<double>(timeout));
+  return watch.done.get_future();
+}
+
+void MotionMonitor::update(const PTUState& state)
+{
+  PTUState::Clock::time_point now = PTUState::Clock::now();
+  PTUState::Sample sample;
+  bool valid = state.last(&sample);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::list<Watch>::iterator it = watches_.begin();
+  while (it != watches_.end())
+  {
+    // The measured rate rather than the polled speed, which in position
+    // mode is the commanded one and does not drop when the unit stops
+    bool reached = valid &&
+                   fabs(sample.pan - it->pan) <= it->tolerance &&
+                   fabs(sample.tilt - it->tilt) <= it->tolerance &&
+                   fabs(sample.panrate) <= it->tolerance &&
+                   fabs(sample.tiltrate) <= it->tolerance;
+    if (reached || now >= it->deadline)
+    {
+      it->done.set_value(reached);
+      it = watches_.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+void MotionMonitor::cancel()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::list<Watch>::iterator it = watches_.begin(); it != watches_.end(); ++it)
+  {
+    it->done.set_value(false);
+  }
+  watches_.clear();
+}
+
+}  // namespace flir_ptu_driver
@@ -0,0 +1,86 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/motion_profile.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace flir_ptu_driver
+{
+
+static double clampSpeed(const AxisProfile& axis, double speed)
+{
+  return std::min(std::max(speed, axis.min_speed), axis.max_speed);
+}
+
+double profileDuration(const AxisProfile& axis, double distance, double speed)
+{
+  distance = fabs(distance);
+  speed = clampSpeed(axis, speed);
+  if (distance == 0) return 0;
+  if (speed <= 0) return HUGE_VAL;
+
+  double v0 = axis.base_speed;
+  double a = axis.acceleration;
+  if (speed <= v0 || a <= 0) return distance / speed;
+
+  // Distance taken by ramping up to speed and back down again
+  double ramps = (speed * speed - v0 * v0) / a;
+  if (distance >= ramps)
+  {
+    return 2 * (speed - v0) / a + (distance - ramps) / speed;
+  }
+  double peak = sqrt(v0 * v0 + a * distance);
+  return 2 * (peak - v0) / a;
+}
+
+double profileSpeed(const AxisProfile& axis, double distance, double duration)
+{
+  distance = fabs(distance);
+  if (distance == 0) return clampSpeed(axis, 0);
+  if (duration <= profileDuration(axis, distance, axis.max_speed)) return axis.max_speed;
+
+  double v0 = axis.base_speed;
+  double a = axis.acceleration;
+  if (distance / duration <= v0 || a <= 0) return clampSpeed(axis, distance / duration);
+
+  // duration = 2 (v - v0) / a + (distance - (v^2 - v0^2) / a) / v, which
+  // rearranges to v^2 - (2 v0 + a duration) v + v0^2 + a distance = 0;
+  // the smaller root is the one with room to cruise.
+  double b = 2 * v0 + a * duration;
+  double discriminant = b * b - 4 * (v0 * v0 + a * distance);
+  if (discriminant < 0) return axis.max_speed;
+  return clampSpeed(axis, (b - sqrt(discriminant)) / 2);
+}
+
+MovePlan planMove(const AxisProfile& pan, const AxisProfile& tilt,
+                  double pan_distance, double tilt_distance)
+{
+  MovePlan plan;
+  double pan_time = profileDuration(pan, pan_distance, pan.max_speed);
+  double tilt_time = profileDuration(tilt, tilt_distance, tilt.max_speed);
+  plan.duration = std::max(pan_time, tilt_time);
+  plan.pan_speed = profileSpeed(pan, pan_distance, plan.duration);
+  plan.tilt_speed = profileSpeed(tilt, tilt_distance, plan.duration);
+  return plan;
+}
+
+}  // namespace flir_ptu_driver
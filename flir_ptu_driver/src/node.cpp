@@ -28,78 +28,71 @@
  *
  */
 
-#include <diagnostic_updater/diagnostic_updater.h>
+#include <flir_ptu_driver/node.h>
 #include <diagnostic_updater/publisher.h>
-#include <flir_ptu_driver/driver.h>
-#include <ros/ros.h>
-#include <sensor_msgs/JointState.h>
+#include <flir_ptu_driver/trajectory.h>
 #include <serial/serial.h>
-#include <std_msgs/Bool.h>
-#include <flir_ptu_driver/PtuDirectControl.h>
-#include <geometry_msgs/Twist.h>
-#include <string>
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <std_msgs/Float64.h>
+#include <std_msgs/String.h>
+#include <flir_ptu_driver/LinkStats.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <boost/bind.hpp>
 
 namespace flir_ptu_driver
 {
 
-  class Node
+  /**
+   * Converts a steady clock time to ROS time, by its distance from now.
+   */
+  static ros::Time toRosTime(PTUState::Clock::time_point stamp)
   {
-    public:
-      explicit Node(ros::NodeHandle& node_handle);
-      ~Node();
+    double ago = std::chrono::duration<double>(PTUState::Clock::now() - stamp).count();
+    return ros::Time::now() - ros::Duration(ago);
+  }
 
-      // Service Control
-      void connect();
-      bool ok()
-      {
-        return m_pantilt != NULL;
-      }
-      void disconnect();
-
-      // Service Execution
-      void spinCallback(const ros::TimerEvent&);
-
-      // Callback Methods
-      void cmdCallback(const sensor_msgs::JointState::ConstPtr& msg);
-      void ptuDirectControlCallback(const flir_ptu_driver::PtuDirectControl::ConstPtr& msg);
-      void ptuJogCallback(const geometry_msgs::Twist::ConstPtr& msg);
-      void resetCallback(const std_msgs::Bool::ConstPtr& msg);
-      void rotateRelativeCallback(const geometry_msgs::Twist::ConstPtr& msg);  
-      void produce_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat);
-
-    protected:
-      diagnostic_updater::Updater* m_updater;
-      PTU* m_pantilt;
-      ros::NodeHandle m_node;
-      ros::Publisher  m_joint_pub;
-      ros::Subscriber m_joint_sub;
-      ros::Subscriber m_direct_sub;
-      ros::Subscriber m_jog_sub;
-      ros::Subscriber m_reset_sub;
-      ros::Subscriber m_rotate_rel_sub;
-
-      serial::Serial m_ser;
-      std::string m_joint_name_prefix;
-      double default_velocity_;
-      double m_jog_step_rads_;
-
-      boost::posix_time::ptime m_jog_mark_;
-      double m_jog_time_limit_;
-  };
-
-  Node::Node(ros::NodeHandle& node_handle)
-    : m_pantilt(NULL), m_node(node_handle)
+  /**
+   * Converts a serial port read timestamp to the steady clock. Both read
+   * CLOCK_MONOTONIC on Linux; a port which cannot time its reads gives
+   * 0, and the fallback is used.
+   */
+  static PTUState::Clock::time_point fromReadTimestamp(uint64_t nanoseconds,
+                                                      PTUState::Clock::time_point fallback)
   {
-    m_updater = new diagnostic_updater::Updater();
+    if (nanoseconds == 0) return fallback;
+    return PTUState::Clock::time_point(std::chrono::duration_cast<PTUState::Clock::duration>(
+                                         std::chrono::nanoseconds(nanoseconds)));
+  }
+
+  Node::Node(ros::NodeHandle& node_handle, ros::NodeHandle& private_node_handle,
+             CalibrationCache* calibrations)
+    : m_calibrations(calibrations), m_polls_pending(0), m_node(node_handle),
+      m_private(private_node_handle)
+  {
+    m_updater = new diagnostic_updater::Updater(m_node, m_private);
     m_updater->setHardwareID("none");
     m_updater->add("PTU Status", this, &Node::produce_diagnostics);
 
-    ros::param::param<std::string>("~joint_name_prefix", m_joint_name_prefix, "ptu_");
-    ros::param::param<double>("~jog_step_rads", m_jog_step_rads_, 0.01);
+    m_private.param<double>("jog_step_rads", m_jog_step_rads_, 0.01);
+    m_private.param<double>("jog_period_min_millis", m_jog_time_limit_, 250);
+    m_private.param<double>("cmd_vel_timeout", m_vel_timeout, 0.5);
+    m_private.param<double>("trajectory_lookahead", m_trajectory_lookahead, 0.05);
+    m_private.param<double>("trajectory_goal_tolerance", m_trajectory_tolerance, 0.01);
+    m_private.param<bool>("split_state", m_split_state, false);
+    m_private.param<bool>("publish_link_stats", m_publish_link_stats, false);
 
-    m_jog_mark_ = boost::posix_time::microsec_clock::local_time();
-    ros::param::param<double>("~jog_period_min_millis", m_jog_time_limit_, 250);
+    // Poll at ~hz while moving, backing off to ~idle_hz at rest
+    int hz, idle_hz;
+    double hold_time, link_share;
+    m_private.param<int>("hz", hz, PTU_DEFAULT_HZ);
+    m_private.param<int>("idle_hz", idle_hz, std::min(hz, PTU_DEFAULT_IDLE_HZ));
+    m_private.param<double>("poll_hold_time", hold_time, 1.0);
+    m_private.param<double>("poll_link_share", link_share, 0.5);
+    m_scheduler.setRates(hz, idle_hz);
+    m_scheduler.setHoldTime(hold_time);
+    m_scheduler.setLinkShare(link_share);
   }
 
   Node::~Node()
@@ -108,7 +101,7 @@ namespace flir_ptu_driver
     delete m_updater;
   }
 
-  /** Opens the connection to the PTU and sets appropriate parameters.
+  /** Opens the connection to each PTU and sets appropriate parameters.
     Also manages subscriptions/publishers */
   void Node::connect()
   {
@@ -118,134 +111,479 @@ namespace flir_ptu_driver
       disconnect();
     }
 
+    // Either one unit on ~port, or several on ~ports, each with a matching
+    // entry in ~joint_name_prefixes.
+    std::vector<std::string> ports, prefixes;
+    if (m_private.getParam("ports", ports))
+    {
+      m_private.getParam("joint_name_prefixes", prefixes);
+      if (prefixes.size() != ports.size())
+      {
+        ROS_ERROR("~joint_name_prefixes must have one entry for each of ~ports.");
+        return;
+      }
+    }
+    else
+    {
+      std::string port, prefix;
+      m_private.param<std::string>("port", port, PTU_DEFAULT_PORT);
+      m_private.param<std::string>("joint_name_prefix", prefix, "ptu_");
+      ports.push_back(port);
+      prefixes.push_back(prefix);
+    }
+
+    m_private.param<double>("default_velocity", default_velocity_, PTU_DEFAULT_VEL);
+
+    // Each of several units records to its own file, named after its
+    // namespace
+    std::string record;
+    m_private.param<std::string>("record", record, "");
+
+    for (size_t i = 0; i < ports.size(); i++)
+    {
+      Device* device = new Device();
+      device->port = ports[i];
+      device->joint_name_prefix = prefixes[i];
+      device->jog_mark = boost::posix_time::microsec_clock::local_time();
+      m_devices.push_back(device);
+
+      // A lone unit keeps its topics and parameters in the node namespace;
+      // with several, each gets a namespace named after its joint prefix.
+      std::string ns;
+      if (ports.size() > 1)
+      {
+        ns = prefixes[i];
+        if (!ns.empty() && ns[ns.length() - 1] == '_')
+        {
+          ns.erase(ns.length() - 1);
+        }
+      }
+      ros::NodeHandle device_node(m_node, ns);
+      if (!record.empty())
+      {
+        device->record_path = ns.empty() ? record : record + "." + ns;
+      }
+
+      if (!connectDevice(device, device_node))
+      {
+        disconnect();
+        return;
+      }
+    }
+
+    prepareStates();
+
+    // Publishers : Only publish the most recent reading
+    m_joint_pub = m_node.advertise
+      <sensor_msgs::JointState>("state", 1);
+    m_age_pub = m_node.advertise
+      <std_msgs::Float64>("state_age", 1);
+
+    // State is published as polls complete, unless a faster rate is
+    // asked for, in which case it is extrapolated between polls.
+    int hz;
+    double publish_rate, max_horizon;
+    m_private.param<int>("hz", hz, PTU_DEFAULT_HZ);
+    m_private.param<double>("publish_rate", publish_rate, hz);
+    m_private.param<double>("max_extrapolation", max_horizon, 0.5);
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      m_devices[i]->state.setMaxHorizon(max_horizon);
+    }
+    if (publish_rate > hz)
+    {
+      m_publish_timer = m_node.createTimer(ros::Duration(1.0 / publish_rate),
+          &Node::publishCallback, this);
+    }
+
+    // Polling ticks at the fastest polling rate, and the scheduler decides
+    // which ticks poll
+    m_spin_timer = m_node.createTimer(ros::Duration(1.0 / hz), &Node::spinCallback, this);
+  }
+
+  /** Opens and initializes one PTU */
+  bool Node::connectDevice(Device* device, ros::NodeHandle& device_node)
+  {
     // Query for serial configuration
-    std::string port;
-    int32_t baud;
+    int32_t baud, max_baud;
     bool limit;
     bool is_dry_run;
+    bool low_latency;
+    bool simulate;
 
-    ros::param::param<std::string>("~port", port, PTU_DEFAULT_PORT);
-    ros::param::param<bool>("~limits_enabled", limit, true);
-    ros::param::param<int32_t>("~baud", baud, PTU_DEFAULT_BAUD);
-    ros::param::param<double>("~default_velocity", default_velocity_, PTU_DEFAULT_VEL);
-    ros::param::param<bool>("~dry_run", is_dry_run, false);
+    m_private.param<bool>("limits_enabled", limit, true);
+    m_private.param<int32_t>("baud", baud, PTU_DEFAULT_BAUD);
+    m_private.param<int32_t>("max_baud", max_baud, PTU_MAX_BAUD);
+    m_private.param<bool>("dry_run", is_dry_run, false);
+    m_private.param<bool>("low_latency", low_latency, false);
+    m_private.param<bool>("simulate", simulate, false);
+    device->baud = baud;
+    device->max_baud = max_baud;
+    device->limits_enabled = limit;
+    device->dry_run = is_dry_run;
+    m_private.param<double>("pan_acceleration", device->pan_acceleration, 0.0);
+    m_private.param<double>("tilt_acceleration", device->tilt_acceleration, 0.0);
+    m_private.param<double>("pan_base_speed", device->pan_base_speed, 0.0);
+    m_private.param<double>("tilt_base_speed", device->tilt_base_speed, 0.0);
+
+    if (simulate)
+    {
+      SimulatorOptions options;
+      options.baud = baud;
+      double latency;
+      m_private.param<double>("simulator_latency", latency, options.latency);
+      options.latency = latency;
+      device->simulator = new Simulator(options);
+      if (!device->simulator->start())
+      {
+        ROS_ERROR("Unable to start the PTU simulator");
+        return false;
+      }
+      ROS_INFO_STREAM("Simulating a FLIR PTU in place of " << device->port);
+      device->port = device->simulator->port();
+    }
 
     // Connect to the PTU
-    ROS_INFO_STREAM("Attempting to connect to FLIR PTU on " << port);
+    ROS_INFO_STREAM("Attempting to connect to FLIR PTU on " << device->port);
+
+    device->io = new IOEngine();
+
+    if (!device->record_path.empty())
+    {
+      int record_size;
+      m_private.param<int>("record_size_mb", record_size, 16);
+      if (device->recorder.open(device->record_path, static_cast<size_t>(record_size) << 20))
+      {
+        device->io->ptu().setRecorder(&device->recorder);
+        ROS_INFO_STREAM("Recording traffic with FLIR PTU to " << device->record_path);
+      }
+      else
+      {
+        ROS_WARN_STREAM("Unable to record to " << device->record_path);
+      }
+    }
+
+    // ~port may name the device by identity rather than path
+    std::string path = m_calibrations ? m_calibrations->resolve(device->port) : device->port;
+    if (path.empty())
+    {
+      ROS_ERROR_STREAM("No single serial port matches " << device->port);
+      return false;
+    }
+    if (path != device->port)
+    {
+      ROS_INFO_STREAM("FLIR PTU " << device->port << " is on " << path);
+    }
 
     try
     {
-      m_ser.setPort(port);
-      m_ser.setBaudrate(baud);
+      device->io->serial().setPort(path);
+      device->io->serial().setBaudrate(baud);
       serial::Timeout to = serial::Timeout(200, 200, 0, 200, 0);
-      m_ser.setTimeout(to);
-      m_ser.open();
+      device->io->serial().setTimeout(to);
+      device->io->serial().setLowLatency(low_latency);
+      device->io->serial().open();
     }
     catch (serial::IOException& e)
     {
-      ROS_ERROR_STREAM("Unable to open port " << port);
-      return;
+      ROS_ERROR_STREAM("Unable to open port " << device->port);
+      return false;
     }
 
     ROS_INFO_STREAM("FLIR PTU serial port opened, now initializing.");
 
-    m_pantilt = new PTU(&m_ser);
-
-    if (!m_pantilt->initialize())
+    // Initialization runs on the I/O thread like every other request, but
+    // nothing else can usefully happen until it is done, so wait for it.
+    // A link which opens and then fails is a failed initialization: the
+    // connect is retried with backoff rather than the error ending the node.
+    bool initialized = false;
+    try
     {
-      ROS_ERROR_STREAM("Could not initialize FLIR PTU on " << port);
-      if (!is_dry_run)
-      {
-        disconnect();
-        return;
-      }
-      else
+      initialized = device->io->post<bool>([this, device](PTU& pantilt)
       {
-        m_pantilt->setDryRun(is_dry_run);
-      }
-      ROS_DEBUG_STREAM("Continuing dry run in spite of failure to initialize");
+        return initializeUnit(device, pantilt);
+      }).get();
+    }
+    catch (const std::exception& e)
+    {
+      ROS_ERROR_STREAM("Serial error initializing FLIR PTU on " << device->port << ": " << e.what());
     }
 
-    if (!limit)
+    if (!initialized)
     {
-      m_pantilt->disableLimits();
-      ROS_INFO("FLIR PTU limits disabled.");
+      ROS_ERROR_STREAM("Could not initialize FLIR PTU on " << device->port);
+      return false;
     }
 
-    ROS_INFO("FLIR PTU initialized.");
+    ROS_INFO_STREAM("FLIR PTU initialized on " << device->port);
 
-    m_node.setParam("min_tilt", m_pantilt->getMin(PTU_TILT));
-    m_node.setParam("max_tilt", m_pantilt->getMax(PTU_TILT));
-    m_node.setParam("min_tilt_speed", m_pantilt->getMinSpeed(PTU_TILT));
-    m_node.setParam("max_tilt_speed", m_pantilt->getMaxSpeed(PTU_TILT));
-    m_node.setParam("tilt_step", m_pantilt->getResolution(PTU_TILT));
+    device->coalescer = new CommandCoalescer(device->io, &device->state);
+    bool minimum_time;
+    m_private.param<bool>("minimum_time_moves", minimum_time, false);
+    device->coalescer->setMinimumTime(minimum_time);
 
-    m_node.setParam("min_pan", m_pantilt->getMin(PTU_PAN));
-    m_node.setParam("max_pan", m_pantilt->getMax(PTU_PAN));
-    m_node.setParam("min_pan_speed", m_pantilt->getMinSpeed(PTU_PAN));
-    m_node.setParam("max_pan_speed", m_pantilt->getMaxSpeed(PTU_PAN));
-    m_node.setParam("pan_step", m_pantilt->getResolution(PTU_PAN));
+    PTU& pantilt = device->io->ptu();
+    device_node.setParam("min_tilt", pantilt.getMin(PTU_TILT));
+    device_node.setParam("max_tilt", pantilt.getMax(PTU_TILT));
+    device_node.setParam("min_tilt_speed", pantilt.getMinSpeed(PTU_TILT));
+    device_node.setParam("max_tilt_speed", pantilt.getMaxSpeed(PTU_TILT));
+    device_node.setParam("tilt_step", pantilt.getResolution(PTU_TILT));
 
-    // Publishers : Only publish the most recent reading
-    m_joint_pub = m_node.advertise
-      <sensor_msgs::JointState>("state", 1);
+    device_node.setParam("min_pan", pantilt.getMin(PTU_PAN));
+    device_node.setParam("max_pan", pantilt.getMax(PTU_PAN));
+    device_node.setParam("min_pan_speed", pantilt.getMinSpeed(PTU_PAN));
+    device_node.setParam("max_pan_speed", pantilt.getMaxSpeed(PTU_PAN));
+    device_node.setParam("pan_step", pantilt.getResolution(PTU_PAN));
 
     // Subscribers : Only subscribe to the most recent instructions
-    m_joint_sub = m_node.subscribe
-      <sensor_msgs::JointState>("cmd", 1, &Node::cmdCallback, this);
+    device->joint_sub = device_node.subscribe<sensor_msgs::JointState>("cmd", 1,
+      boost::bind(&Node::cmdCallback, this, _1, device));
 
-    // Subscribers : Only subscribe to the most recent instructions
-    m_direct_sub = m_node.subscribe
-      <flir_ptu_driver::PtuDirectControl>("direct_control", 1, &Node::ptuDirectControlCallback, this);
+    // Raw commands are batched rather than dropped, and their responses
+    // published instead of being left for the poller to trip over
+    device->direct_pub = device_node.advertise<std_msgs::String>("direct_control_response", 10);
+    if (m_publish_link_stats)
+    {
+      device->stats_pub = device_node.advertise<flir_ptu_driver::LinkStats>("link_stats", 1);
+    }
+    ros::Publisher* direct_pub = &device->direct_pub;
+    device->direct = new RawCommandQueue(device->io, [direct_pub](const std::string& responses)
+    {
+      if (responses.empty()) return;
+      std_msgs::String msg;
+      msg.data = responses;
+      direct_pub->publish(msg);
+    });
+    device->direct_sub = device_node.subscribe<flir_ptu_driver::PtuDirectControl>("direct_control", 16,
+      boost::bind(&Node::ptuDirectControlCallback, this, _1, device));
+
+    device->jog_sub = device_node.subscribe<geometry_msgs::Twist>("jogging", 1,
+      boost::bind(&Node::ptuJogCallback, this, _1, device));
+
+    device->vel_sub = device_node.subscribe<geometry_msgs::Twist>("cmd_vel", 1,
+      boost::bind(&Node::velocityCallback, this, _1, device));
+
+    device->rotate_rel_sub = device_node.subscribe<geometry_msgs::Twist>("rotate_relative", 1,
+      boost::bind(&Node::rotateRelativeCallback, this, _1, device));
+
+    device->reset_sub = device_node.subscribe<std_msgs::Bool>("reset", 1,
+      boost::bind(&Node::resetCallback, this, _1, device));
+
+    device->trajectory_server = new TrajectoryServer(device_node, "follow_joint_trajectory",
+      boost::bind(&Node::trajectoryCallback, this, _1, device), false);
+    device->trajectory_server->start();
+
+    return true;
+  }
+
+  /**
+   * Initializes the unit at whichever rate it is listening on, then moves
+   * the link to the fastest rate allowed. A calibration cached for the
+   * same device is reused, and the one read is cached.
+   */
+  bool Node::initializeUnit(Device* device, PTU& pantilt)
+  {
+    serial::Serial& ser = device->io->serial();
+    device->identity = m_calibrations ? m_calibrations->identify(ser.getPort()) : "";
+    Calibration cached;
+    const Calibration* calibration = NULL;
+    if (m_calibrations && m_calibrations->find(device->identity, &cached))
+    {
+      calibration = &cached;
+    }
+
+    // The unit keeps a negotiated rate until it is power cycled, so after
+    // a restart of the driver or a dropped link it may be at either rate.
+    uint32_t rates[] = { static_cast<uint32_t>(ser.getBaudrate()),
+                         static_cast<uint32_t>(device->baud),
+                         static_cast<uint32_t>(device->max_baud) };
+    size_t count = device->max_baud > device->baud ? 3 : 2;
+    bool ok = false;
+    for (size_t i = 0; i < count && !ok; i++)
+    {
+      if (std::find(rates, rates + i, rates[i]) != rates + i) continue;
+      if (i > 0)
+      {
+        ROS_INFO_STREAM("Retrying FLIR PTU at " << rates[i] << " baud");
+        ser.setBaudrate(rates[i]);
+        ser.flushInput();
+      }
+      ok = pantilt.initialize(calibration);
+    }
+
+    if (ok)
+    {
+      if (m_calibrations)
+      {
+        m_calibrations->store(device->identity, pantilt.calibration());
+      }
+      if (device->max_baud > device->baud)
+      {
+        pantilt.negotiateBaud(device->max_baud);
+      }
+    }
+    else
+    {
+      ser.setBaudrate(device->baud);
+      if (!device->dry_run) return false;
+      pantilt.setDryRun(device->dry_run);
+      ROS_DEBUG_STREAM("Continuing dry run in spite of failure to initialize");
+    }
+
+    if (!device->limits_enabled)
+    {
+      pantilt.disableLimits();
+      ROS_INFO("FLIR PTU limits disabled.");
+    }
+    if (device->pan_acceleration > 0)
+    {
+      pantilt.setAcceleration(PTU_PAN, device->pan_acceleration);
+    }
+    if (device->tilt_acceleration > 0)
+    {
+      pantilt.setAcceleration(PTU_TILT, device->tilt_acceleration);
+    }
+    if (device->pan_base_speed > 0)
+    {
+      pantilt.setBaseSpeed(PTU_PAN, device->pan_base_speed);
+    }
+    if (device->tilt_base_speed > 0)
+    {
+      pantilt.setBaseSpeed(PTU_TILT, device->tilt_base_speed);
+    }
+    return true;
+  }
 
-    m_jog_sub = m_node.subscribe
-      <geometry_msgs::Twist>("jogging", 1, &Node::ptuJogCallback, this);
+  /**
+   * Reopens the port after a serial error and brings the unit back up in
+   * place, keeping subscriptions, parameters and state. Attempts back off
+   * from PTU_RECONNECT_MIN to PTU_RECONNECT_MAX seconds.
+   */
+  void Node::resumeDevice(Device* device, PTU& pantilt)
+  {
+    PTUState::Clock::time_point now = PTUState::Clock::now();
+    if (!device->link_lost.exchange(true))
+    {
+      ROS_ERROR_STREAM("Lost link to FLIR PTU on " << device->port << ", reconnecting.");
+      device->monitor.cancel();
+      device->vel_active = false;
+      device->resume_backoff = PTU_RECONNECT_MIN;
+      device->resume_at = now;
+    }
+    if (now < device->resume_at) return;
 
-    m_rotate_rel_sub = m_node.subscribe
-      <geometry_msgs::Twist>("rotate_relative", 1, &Node::rotateRelativeCallback, this);
+    serial::Serial& ser = device->io->serial();
+    bool resumed = false;
+    try
+    {
+      try
+      {
+        ser.close();
+      }
+      catch (const serial::IOException&)
+      {
+        // The descriptor is released all the same
+      }
+      // An adapter named by identity may come back under another path
+      std::string path = m_calibrations ? m_calibrations->resolve(device->port) : device->port;
+      if (!path.empty() && path != ser.getPort())
+      {
+        ROS_INFO_STREAM("FLIR PTU " << device->port << " is now on " << path);
+        ser.setPort(path);
+      }
+      ser.open();
+      resumed = initializeUnit(device, pantilt);
+    }
+    catch (const std::exception& e)
+    {
+      ROS_DEBUG_STREAM("Reconnecting to FLIR PTU on " << device->port << ": " << e.what());
+    }
+
+    if (!resumed)
+    {
+      device->resume_at = now + std::chrono::duration_cast<PTUState::Clock::duration>(
+                            std::chrono::duration<double>(device->resume_backoff));
+      device->resume_backoff = std::min(device->resume_backoff * 2, PTU_RECONNECT_MAX);
+      return;
+    }
 
-    m_reset_sub = m_node.subscribe
-      <std_msgs::Bool>("reset",1, &Node::resetCallback, this);
+    device->io->resetLinkLost();
+    device->link_lost = false;
+    device->refresh_mode = true;
+    ROS_INFO_STREAM("FLIR PTU on " << device->port << " reconnected.");
   }
 
   /** Disconnect */
   void Node::disconnect()
   {
-    if (m_pantilt != NULL)
+    m_spin_timer.stop();
+    m_publish_timer.stop();
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      m_devices[i]->stopping = true;
+      delete m_devices[i]->trajectory_server;  // Waits for a running goal to give up
+      m_devices[i]->trajectory_server = NULL;
+    }
+    // Every I/O thread must be done before any device goes, since the last
+    // poll to finish runs pollsDone across all of them
+    for (size_t i = 0; i < m_devices.size(); i++)
     {
-      delete m_pantilt;   // Closes the connection
-      m_pantilt = NULL;   // Marks the service as disconnected
+      if (m_devices[i]->io) m_devices[i]->io->stop();
     }
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      Device* device = m_devices[i];
+      delete device->io;  // Closes the connection
+      // Pending flushes reference these, so they go after the engine
+      delete device->coalescer;
+      delete device->direct;
+      delete device->simulator;
+      delete device;
+    }
+    m_devices.clear();  // Marks the service as disconnected
+    m_polls_pending = 0;
   }
 
   /** Callback for resetting PTU */
-  void Node::resetCallback(const std_msgs::Bool::ConstPtr& msg)
+  void Node::resetCallback(const std_msgs::Bool::ConstPtr& msg, Device* device)
   {
     ROS_INFO("Resetting the PTU");
-    m_pantilt->home();
+    if (!ok()) return;
+
+    device->monitor.cancel();
+    m_scheduler.activity(PTUState::Clock::now());
+    device->io->post<bool>([](PTU& pantilt) { return pantilt.home(); });
   }
 
   /** Callback for applying direct control messages for the api **/
-  void Node::ptuDirectControlCallback(const flir_ptu_driver::PtuDirectControl::ConstPtr& msg)
+  void Node::ptuDirectControlCallback(const flir_ptu_driver::PtuDirectControl::ConstPtr& msg,
+                                      Device* device)
   {
     ROS_DEBUG_STREAM_NAMED("flir_node", "PTU Direct Message Callback msg of length "<<msg->length);
     if (!ok()) return;
 
-    const uint8_t * command = &*(msg->command.begin());
-    uint32_t length = msg->length;
+    if (msg->length > msg->command.size())
+    {
+      ROS_ERROR("Direct control message is shorter than its length field.");
+      return;
+    }
 
-    m_pantilt->sendCommand(command, length);
+    m_scheduler.activity(PTUState::Clock::now());
+    if (!device->direct->push(msg->command.data(), msg->length))
+    {
+      ROS_ERROR("No memory to queue direct control message.");
+    }
   }
 
   /** Callback for jogging the PTU via API calls **/
-  void Node::ptuJogCallback(const geometry_msgs::Twist::ConstPtr& msg)
+  void Node::ptuJogCallback(const geometry_msgs::Twist::ConstPtr& msg, Device* device)
   {
     ROS_DEBUG_STREAM_NAMED("flir_node", "PTU Jogging Callback");
 
     if (!ok()) return;
 
     boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
-    boost::posix_time::time_duration elapsed_milliseconds = now - m_jog_mark_;
+    boost::posix_time::time_duration elapsed_milliseconds = now - device->jog_mark;
     if (elapsed_milliseconds.total_milliseconds() < m_jog_time_limit_)
     {
       ROS_INFO_STREAM_NAMED("flir_nod", "PTU Jog Requested prematurely at "<< elapsed_milliseconds.total_milliseconds() << " < " << m_jog_time_limit_);
@@ -260,16 +598,28 @@ namespace flir_ptu_driver
 
     float pan = msg->angular.x * m_jog_step_rads_;
     float tilt = msg->angular.y * m_jog_step_rads_;
-    if (m_pantilt->offsetPosition(pan, tilt))
-    {
-      ROS_DEBUG_STREAM_NAMED("flir_node", "PTU offset successfully");
-    }
-    m_jog_mark_ = now;
+    device->vel_active = false;
+    m_scheduler.activity(PTUState::Clock::now());
+    device->coalescer->addOffset(pan, tilt);
+    device->jog_mark = now;
     ROS_INFO_STREAM_NAMED("flir_node", "PTU Jog Requested after "<< elapsed_milliseconds.total_milliseconds() << " > " << m_jog_time_limit_);
   }
 
+  /** Callback for driving the PTU in velocity mode, angular.x being the
+   * pan rate and angular.y the tilt rate in radians/second. The unit stops
+   * if no new command arrives within ~cmd_vel_timeout seconds. */
+  void Node::velocityCallback(const geometry_msgs::Twist::ConstPtr& msg, Device* device)
+  {
+    if (!ok()) return;
+
+    m_scheduler.activity(PTUState::Clock::now());
+    device->coalescer->setVelocity(msg->angular.x, msg->angular.y);
+    device->vel_mark = ros::Time::now();
+    device->vel_active = true;
+  }
+
   /** Callback for getting new Goal JointState */
-  void Node::cmdCallback(const sensor_msgs::JointState::ConstPtr& msg)
+  void Node::cmdCallback(const sensor_msgs::JointState::ConstPtr& msg, Device* device)
   {
     ROS_DEBUG("PTU command callback.");
     if (!ok()) return;
@@ -296,13 +646,12 @@ namespace flir_ptu_driver
       tiltspeed = default_velocity_;
     }
 
-    m_pantilt->setPosition(PTU_PAN, pan);
-    m_pantilt->setPosition(PTU_TILT, tilt);
-    m_pantilt->setSpeed(PTU_PAN, panspeed);
-    m_pantilt->setSpeed(PTU_TILT, tiltspeed);
+    device->vel_active = false;
+    m_scheduler.activity(PTUState::Clock::now());
+    device->coalescer->setTarget(pan, tilt, panspeed, tiltspeed);
   }
 
-  void Node::rotateRelativeCallback(const geometry_msgs::Twist::ConstPtr& msg)
+  void Node::rotateRelativeCallback(const geometry_msgs::Twist::ConstPtr& msg, Device* device)
   {
     ROS_DEBUG_STREAM_NAMED("flir_node", "PTU rotate relative callback with rotation request pan "
         << msg->angular.x << "rad. and tilt " << msg->angular.y << "rad.");
@@ -310,78 +659,524 @@ namespace flir_ptu_driver
 
     float pan = msg->angular.x;
     float tilt = msg->angular.y;
-    if (m_pantilt->offsetPosition(pan, tilt))
+    device->vel_active = false;
+    m_scheduler.activity(PTUState::Clock::now());
+    device->coalescer->addOffset(pan, tilt);
+  }
+
+  /**
+   * Runs a FollowJointTrajectory goal on the action server's thread. The
+   * whole trajectory is turned into commands up front; each segment is
+   * then sent as one pipelined slaved group, a little ahead of the time
+   * the previous waypoint is due, so the unit moves on without stopping.
+   */
+  void Node::trajectoryCallback(const control_msgs::FollowJointTrajectoryGoalConstPtr& goal, Device* device)
+  {
+    TrajectoryServer* server = device->trajectory_server;
+    const trajectory_msgs::JointTrajectory& trajectory = goal->trajectory;
+    control_msgs::FollowJointTrajectoryResult result;
+
+    // A joint left out of the goal holds its current position
+    int pan_index = -1, tilt_index = -1;
+    for (size_t i = 0; i < trajectory.joint_names.size(); i++)
+    {
+      if (trajectory.joint_names[i] == device->joint_name_prefix + "pan") pan_index = i;
+      if (trajectory.joint_names[i] == device->joint_name_prefix + "tilt") tilt_index = i;
+    }
+    if (pan_index < 0 && tilt_index < 0)
+    {
+      result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_JOINTS;
+      server->setAborted(result, "Trajectory has no joints of this PTU");
+      return;
+    }
+
+    device->vel_active = false;
+    PTUState::Sample current;
+    if (!device->state.last(&current))
+    {
+      result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_GOAL;
+      server->setAborted(result, "PTU position is not known yet");
+      return;
+    }
+
+    std::vector<Waypoint> waypoints;
+    for (size_t i = 0; i < trajectory.points.size(); i++)
     {
-      ROS_DEBUG_STREAM_NAMED("flir_node", "PTU offset successfully");
+      const trajectory_msgs::JointTrajectoryPoint& point = trajectory.points[i];
+      if (point.positions.size() != trajectory.joint_names.size())
+      {
+        result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_GOAL;
+        server->setAborted(result, "Trajectory point has wrong number of positions");
+        return;
+      }
+      Waypoint waypoint;
+      waypoint.time = point.time_from_start.toSec();
+      waypoint.pan = pan_index >= 0 ? point.positions[pan_index] : current.pan;
+      waypoint.tilt = tilt_index >= 0 ? point.positions[tilt_index] : current.tilt;
+      waypoints.push_back(waypoint);
+    }
+
+    // Copied on the I/O thread, where resumeDevice may be initializing the
+    // unit afresh
+    Calibration calibration;
+    bool limits_enabled = false;
+    bool initialized = device->io->post<bool>([&calibration, &limits_enabled](PTU& pantilt)
+    {
+      if (!pantilt.initialized()) return false;
+      calibration = pantilt.calibration();
+      limits_enabled = pantilt.limitsEnabled();
+      return true;
+    }).get();
+    if (!initialized)
+    {
+      result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_GOAL;
+      server->setAborted(result, "PTU is not initialized");
+      return;
     }
+
+    std::vector<TrajectorySegment> segments;
+    std::string error = planTrajectory(calibration, limits_enabled, current.pan, current.tilt,
+                                       waypoints, &segments);
+    if (!error.empty())
+    {
+      result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_GOAL;
+      server->setAborted(result, error);
+      return;
+    }
+    if (segments.empty())
+    {
+      server->setSucceeded(result);
+      return;
+    }
+
+    ros::Time start = trajectory.header.stamp.isZero() ? ros::Time::now() : trajectory.header.stamp;
+    control_msgs::FollowJointTrajectoryFeedback feedback;
+    feedback.joint_names.push_back(device->joint_name_prefix + "pan");
+    feedback.joint_names.push_back(device->joint_name_prefix + "tilt");
+    feedback.desired.positions.resize(2);
+    feedback.actual.positions.resize(2);
+    feedback.error.positions.resize(2);
+
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+      const TrajectorySegment& segment = segments[i];
+      if (!waitForTrajectory(start + ros::Duration(segment.start - m_trajectory_lookahead), device))
+      {
+        stopTrajectory(device);
+        return;
+      }
+
+      // Extrapolation may run on to this waypoint, and no further
+      const TrajectorySegment* sending = &segment;
+      m_scheduler.activity(PTUState::Clock::now());
+      if (!device->io->post<bool>([sending, device](PTU& pantilt)
+          {
+            if (!pantilt.setMode(PTU_POSITION) || !pantilt.sendSlavedGroup(sending->commands)) return false;
+            device->state.setTarget(PTU_PAN, sending->pan);
+            device->state.setTarget(PTU_TILT, sending->tilt);
+            return true;
+          }).get())
+      {
+        haltTrajectory(device);
+        server->setAborted(result, "PTU rejected a trajectory segment");
+        return;
+      }
+
+      PTUState::Sample actual;
+      device->state.predict(PTUState::Clock::now(), &actual);
+      feedback.header.stamp = ros::Time::now();
+      feedback.desired.positions[0] = segment.pan;
+      feedback.desired.positions[1] = segment.tilt;
+      feedback.actual.positions[0] = actual.pan;
+      feedback.actual.positions[1] = actual.tilt;
+      feedback.error.positions[0] = segment.pan - actual.pan;
+      feedback.error.positions[1] = segment.tilt - actual.tilt;
+      server->publishFeedback(feedback);
+    }
+
+    // Done once the polled state settles on the last waypoint
+    double tolerance = m_trajectory_tolerance;
+    for (size_t i = 0; i < goal->goal_tolerance.size(); i++)
+    {
+      const control_msgs::JointTolerance& joint = goal->goal_tolerance[i];
+      if (joint.position > 0 && (joint.name == device->joint_name_prefix + "pan" ||
+                                 joint.name == device->joint_name_prefix + "tilt"))
+      {
+        tolerance = joint.position;
+      }
+    }
+    double slack = goal->goal_time_tolerance.isZero() ? 1.0 : goal->goal_time_tolerance.toSec();
+    double remaining = segments.back().end - (ros::Time::now() - start).toSec();
+    std::future<bool> reached = device->monitor.watch(segments.back().pan, segments.back().tilt,
+                                                      tolerance, std::max(remaining, 0.0) + slack);
+    while (reached.wait_for(std::chrono::milliseconds(20)) != std::future_status::ready)
+    {
+      if (device->stopping || server->isPreemptRequested() || !ros::ok())
+      {
+        stopTrajectory(device);
+        return;
+      }
+    }
+
+    if (reached.get())
+    {
+      server->setSucceeded(result);
+    }
+    else
+    {
+      result.error_code = control_msgs::FollowJointTrajectoryResult::GOAL_TOLERANCE_VIOLATED;
+      server->setAborted(result, "PTU did not reach the final waypoint in time");
+    }
+  }
+
+  bool Node::waitForTrajectory(const ros::Time& until, Device* device)
+  {
+    while (true)
+    {
+      if (device->stopping || device->trajectory_server->isPreemptRequested() || !ros::ok())
+      {
+        return false;
+      }
+      ros::Duration remaining = until - ros::Time::now();
+      if (!(remaining > ros::Duration(0)))
+      {
+        return true;
+      }
+      // Short enough to notice a preempt promptly
+      std::min(remaining, ros::Duration(0.01)).sleep();
+    }
+  }
+
+  void Node::stopTrajectory(Device* device)
+  {
+    device->monitor.cancel();
+    if (!device->stopping)
+    {
+      haltTrajectory(device);
+    }
+    device->trajectory_server->setPreempted();
+  }
+
+  void Node::haltTrajectory(Device* device)
+  {
+    // The unit stops short of the segment's waypoint
+    device->io->post<bool>([device](PTU& pantilt)
+    {
+      device->state.clearTargets();
+      return pantilt.halt();
+    });
   }
+
+  /** Only called through m_updater->update() from pollsDone. */
   void Node::produce_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat)
   {
     stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "All normal.");
-    stat.add("PTU Mode", m_pantilt->getMode() == PTU_POSITION ? "Position" : "Velocity");
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      Device* device = m_devices[i];
+      std::string suffix;
+      if (m_devices.size() > 1)
+      {
+        suffix = " (" + device->port + ")";
+      }
+      if (device->link_lost)
+      {
+        stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::ERROR, "Link lost, reconnecting");
+      }
+      stat.add("PTU Mode" + suffix, device->state.mode() == PTU_POSITION ? "Position" : "Velocity");
+      device->refresh_mode = true;
+
+      PTUState::Sample sample;
+      device->state.predict(PTUState::Clock::now(), &sample);
+      stat.add("State age" + suffix, sample.age);
+
+      produceLinkDiagnostics(stat, device, suffix);
+    }
+  }
+
+  void Node::produceLinkDiagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat,
+                                    Device* device, const std::string& suffix)
+  {
+    std::vector<CommandStats::Snapshot> snapshots;
+    device->io->ptu().stats().snapshot(&snapshots);
+    ros::Time now = ros::Time::now();
+    double interval = device->stats_time.isZero() ? 0 : (now - device->stats_time).toSec();
+
+    flir_ptu_driver::LinkStats msg;
+    msg.header.stamp = now;
+    msg.port = device->port;
+    msg.interval = interval;
+
+    for (size_t i = 0; i < snapshots.size(); i++)
+    {
+      // Only what happened since the last update
+      CommandStats::Snapshot recent = snapshots[i];
+      for (size_t j = 0; j < device->stats_mark.size(); j++)
+      {
+        if (device->stats_mark[j].mnemonic == recent.mnemonic)
+        {
+          recent.subtract(device->stats_mark[j]);
+          break;
+        }
+      }
+      if (recent.count == 0 || interval <= 0) continue;
+
+      flir_ptu_driver::LinkStat command;
+      command.mnemonic = recent.mnemonic;
+      command.count = recent.count;
+      command.rate = recent.count / interval;
+      command.p50 = recent.percentile(0.50);
+      command.p95 = recent.percentile(0.95);
+      command.p99 = recent.percentile(0.99);
+      command.timeouts = recent.timeouts;
+      command.naks = recent.naks;
+      command.bytes_out = recent.bytes_out;
+      command.bytes_in = recent.bytes_in;
+      msg.commands.push_back(command);
+
+      stat.addf("Link " + command.mnemonic + suffix,
+                "%.1f/s, p50 %.1f p95 %.1f p99 %.1f ms, %lu timeouts, %lu NAKs, %.0f B/s out, %.0f B/s in",
+                command.rate, command.p50 * 1e3, command.p95 * 1e3, command.p99 * 1e3,
+                static_cast<unsigned long>(command.timeouts), static_cast<unsigned long>(command.naks),
+                command.bytes_out / interval, command.bytes_in / interval);
+      if (command.timeouts > 0)
+      {
+        stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Link timeouts");
+      }
+      else if (command.naks > 0)
+      {
+        stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Commands refused");
+      }
+    }
+
+    if (m_publish_link_stats && interval > 0)
+    {
+      device->stats_pub.publish(msg);
+    }
+    device->stats_mark.swap(snapshots);
+    device->stats_time = now;
   }
 
 
   /**
-   * Publishes a joint_state message with position and speed.
-   * Also sends out updated TF info.
+   * Queues a state poll on every device once the scheduler says a round
+   * is due, unless the previous round is still waiting on a serial link.
+   * The devices are polled concurrently, each on its own I/O thread, and
+   * behind any commands already queued there.
    */
   void Node::spinCallback(const ros::TimerEvent&)
   {
     if (!ok()) return;
 
-    // Read Position & Speed
-    double pan  = m_pantilt->getPosition(PTU_PAN);
-    double tilt = m_pantilt->getPosition(PTU_TILT);
-
-    double panspeed  = m_pantilt->getSpeed(PTU_PAN);
-    double tiltspeed = m_pantilt->getSpeed(PTU_TILT);
-
-    // Publish Position & Speed
-    sensor_msgs::JointState joint_state;
-    joint_state.header.stamp = ros::Time::now();
-    joint_state.name.resize(2);
-    joint_state.position.resize(2);
-    joint_state.velocity.resize(2);
-    joint_state.name[0] = m_joint_name_prefix + "pan";
-    joint_state.position[0] = pan;
-    joint_state.velocity[0] = panspeed;
-    joint_state.name[1] = m_joint_name_prefix + "tilt";
-    joint_state.position[1] = tilt;
-    joint_state.velocity[1] = tiltspeed;
-    m_joint_pub.publish(joint_state);
+    // cmd_vel watchdog
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      Device* device = m_devices[i];
+      if (device->vel_active && (ros::Time::now() - device->vel_mark).toSec() > m_vel_timeout)
+      {
+        ROS_WARN_STREAM("No cmd_vel for " << m_vel_timeout << "s, stopping PTU on " << device->port);
+        device->coalescer->setVelocity(0, 0);
+        device->vel_active = false;
+      }
+    }
+    if (m_polls_pending != 0) return;
+
+    PTUState::Clock::time_point now = PTUState::Clock::now();
+    if (!m_scheduler.due(now)) return;
+
+    m_poll_start = now;
+    m_polls_pending = m_devices.size();
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      Device* device = m_devices[i];
+      device->io->post<void>([this, device](PTU& pantilt) { pollDevice(device, pantilt); },
+                             IOEngine::POLL);
+    }
+  }
+
+  /** Reads one device's state, and publishes once every device is done. */
+  void Node::pollDevice(Device* device, PTU& pantilt)
+  {
+    device->moving = device->vel_active;
+    device->poll_seconds = 0;
+    if (device->io->linkLost() || device->link_lost)
+    {
+      resumeDevice(device, pantilt);
+    }
+    else
+    {
+      try
+      {
+        PTUState::Clock::time_point begun = PTUState::Clock::now();
+        readState(device, pantilt);
+        device->poll_seconds = std::chrono::duration<double>(PTUState::Clock::now() - begun).count();
+      }
+      catch (const std::exception& e)
+      {
+        ROS_DEBUG_STREAM("Polling FLIR PTU on " << device->port << ": " << e.what());
+        resumeDevice(device, pantilt);
+      }
+    }
+    device->byte_time_ns = device->io->serial().getByteTimeNs();
+
+    if (--m_polls_pending == 0)
+    {
+      pollsDone();
+    }
+  }
 
+  void Node::readState(Device* device, PTU& pantilt)
+  {
+    // Read Position & Speed in one round trip
+    float pan, tilt, panspeed, tiltspeed;
+    PTUState::Clock::time_point stamp = PTUState::Clock::now();
+    StateStamps arrivals = StateStamps();
+    PTUState::Sample previous;
+    bool had_sample = device->state.last(&previous);
+    if (pantilt.getState(&pan, &tilt, &panspeed, &tiltspeed, &arrivals))
+    {
+      // Any change of a step or more means an axis is moving
+      if (had_sample)
+      {
+        device->moving = device->moving ||
+          fabs(pan - previous.pan) > pantilt.getResolution(PTU_PAN) / 2 ||
+          fabs(tilt - previous.tilt) > pantilt.getResolution(PTU_TILT) / 2;
+      }
+      device->state.update(pan, tilt, panspeed, tiltspeed,
+                           fromReadTimestamp(arrivals.pan, stamp),
+                           fromReadTimestamp(arrivals.tilt, stamp));
+      if (m_split_state)
+      {
+        PTUState::Sample sample;
+        device->state.last(&sample);
+        publishSplitState(device, sample);
+      }
+    }
+    device->monitor.update(device->state);
+
+    if (device->refresh_mode.exchange(false))
+    {
+      device->state.setMode(pantilt.getMode());
+    }
+  }
+
+  void Node::pollsDone()
+  {
+    // Every poll has finished, so their results are visible here
+    bool moving = false;
+    uint32_t byte_time_ns = 0;
+    double exchange = 0;
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      moving = moving || m_devices[i]->moving;
+      byte_time_ns = std::max(byte_time_ns, m_devices[i]->byte_time_ns);
+      exchange = std::max(exchange, m_devices[i]->poll_seconds);
+    }
+    m_scheduler.completed(m_poll_start, PTUState::Clock::now(), exchange, moving, byte_time_ns);
+
+    if (!m_publish_timer.isValid() && !m_split_state)
+    {
+      publishState();
+    }
     m_updater->update();
   }
 
-}  // namespace flir_ptu_driver
+  void Node::publishCallback(const ros::TimerEvent&)
+  {
+    if (!ok() || m_split_state) return;
+    publishState();
+  }
 
-int main(int argc, char** argv)
-{
-  ros::init(argc, argv, "ptu");
-  ros::NodeHandle n;
+  void Node::prepareStates()
+  {
+    sensor_msgs::JointState all;
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      Device* device = m_devices[i];
+      sensor_msgs::JointState axis;
+      axis.name.push_back(device->joint_name_prefix + "pan");
+      axis.position.push_back(0);
+      axis.velocity.push_back(0);
+      device->pan_states.setPrototype(axis);
+      all.name.push_back(axis.name[0]);
 
-  while (ros::ok())
+      axis.name[0] = device->joint_name_prefix + "tilt";
+      device->tilt_states.setPrototype(axis);
+      all.name.push_back(axis.name[0]);
+    }
+    all.position.resize(all.name.size());
+    all.velocity.resize(all.name.size());
+    m_joint_states.setPrototype(all);
+  }
+
+  void Node::publishSplitState(Device* device, const PTUState::Sample& sample)
   {
-    // Connect to PTU
-    flir_ptu_driver::Node ptu_node(n);
-    ptu_node.connect();
+    MessagePool<sensor_msgs::JointState>::Ptr pan = device->pan_states.acquire();
+    pan->position[0] = sample.pan;
+    pan->velocity[0] = sample.panspeed;
+    pan->header.stamp = toRosTime(sample.pan_stamp);
+    m_joint_pub.publish(pan);
 
-    // Set up polling callback
-    int hz;
-    ros::param::param<int>("~hz", hz, PTU_DEFAULT_HZ);
-    ros::Timer spin_timer = n.createTimer(ros::Duration(1 / hz),
-        &flir_ptu_driver::Node::spinCallback, &ptu_node);
+    MessagePool<sensor_msgs::JointState>::Ptr tilt = device->tilt_states.acquire();
+    tilt->position[0] = sample.tilt;
+    tilt->velocity[0] = sample.tiltspeed;
+    tilt->header.stamp = toRosTime(sample.tilt_stamp);
+    m_joint_pub.publish(tilt);
+  }
 
-    // Spin until there's a problem or we're in shutdown
-    ros::spin();
+  /**
+   * Publishes a joint_state message with position and speed of every
+   * device, along with the age of the oldest poll it was built from.
+   * Also sends out updated TF info.
+   */
+  void Node::publishState()
+  {
+    // Publish Position & Speed. Only the numbers of a pooled message are
+    // rewritten; its names were set by prepareStates.
+    MessagePool<sensor_msgs::JointState>::Ptr joint_state = m_joint_states.acquire();
+    PTUState::Clock::time_point now = PTUState::Clock::now();
+    PTUState::Clock::time_point stamp = now;
+    std_msgs::Float64 age;
+    age.data = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      const Device* device = m_devices[i];
+      PTUState::Sample sample;
+      if (!device->state.predict(now, &sample)) continue;
+
+      joint_state->position[2 * i] = sample.pan;
+      joint_state->velocity[2 * i] = sample.panspeed;
+      joint_state->position[2 * i + 1] = sample.tilt;
+      joint_state->velocity[2 * i + 1] = sample.tiltspeed;
+      age.data = std::max(age.data, sample.age);
+      stamp = std::min(stamp, sample.pan_stamp);
+      count++;
+    }
+    if (count == 0) return;
 
-    if (!ptu_node.ok())
+    if (count < m_devices.size())
     {
-      ROS_ERROR("FLIR PTU disconnected, attempting reconnection.");
-      ros::Duration(1.0).sleep();
+      // Devices with no state yet are left out, in a message of its own
+      MessagePool<sensor_msgs::JointState>::Ptr partial(new sensor_msgs::JointState());
+      for (size_t i = 0; i < m_devices.size(); i++)
+      {
+        PTUState::Sample sample;
+        if (!m_devices[i]->state.predict(now, &sample)) continue;
+        for (size_t j = 2 * i; j < 2 * i + 2; j++)
+        {
+          partial->name.push_back(joint_state->name[j]);
+          partial->position.push_back(joint_state->position[j]);
+          partial->velocity.push_back(joint_state->velocity[j]);
+        }
+      }
+      joint_state = partial;
     }
+
+    // Positions are extrapolated to now unless the horizon runs out first
+    joint_state->header.stamp = toRosTime(stamp);
+    m_joint_pub.publish(joint_state);
+    m_age_pub.publish(age);
   }
 
-  return 0;
-}
+}  // namespace flir_ptu_driver
@@ -0,0 +1,77 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/calibration_cache.h>
+#include <flir_ptu_driver/node.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+
+#include <algorithm>
+
+#include <boost/scoped_ptr.hpp>
+
+namespace flir_ptu_driver
+{
+
+/**
+ * Runs a Node inside a nodelet manager. Topics and parameters are the
+ * nodelet's, as they would be ptu_node's. onInit must not block the
+ * manager, so connecting, which opens and initializes every unit, runs
+ * from a one-shot timer; a failed connect is retried from it with
+ * backoff.
+ */
+class PTUNodelet : public nodelet::Nodelet
+{
+public:
+  PTUNodelet() : backoff_(PTU_RECONNECT_MIN)
+  {
+  }
+
+private:
+  virtual void onInit()
+  {
+    node_.reset(new Node(getNodeHandle(), getPrivateNodeHandle(), &calibrations_));
+    connect_timer_ = getNodeHandle().createTimer(ros::Duration(0), &PTUNodelet::connect, this, true);
+  }
+
+  void connect(const ros::TimerEvent&)
+  {
+    node_->connect();
+    if (node_->ok())
+    {
+      backoff_ = PTU_RECONNECT_MIN;
+      return;
+    }
+
+    NODELET_ERROR_STREAM("Could not connect to FLIR PTU, retrying in " << backoff_ << "s.");
+    connect_timer_ = getNodeHandle().createTimer(ros::Duration(backoff_), &PTUNodelet::connect, this, true);
+    backoff_ = std::min(backoff_ * 2, PTU_RECONNECT_MAX);
+  }
+
+  CalibrationCache calibrations_;
+  boost::scoped_ptr<Node> node_;
+  ros::Timer connect_timer_;
+  double backoff_;
+};
+
+}  // namespace flir_ptu_driver
+
+PLUGINLIB_EXPORT_CLASS(flir_ptu_driver::PTUNodelet, nodelet::Nodelet)
@@ -0,0 +1,106 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/poll_scheduler.h>
+
+#include <algorithm>
+
+namespace flir_ptu_driver
+{
+
+PollScheduler::PollScheduler()
+  : active_period_(0.1), idle_period_(0.5), hold_time_(1.0), link_share_(0.5),
+    interval_(0.1), polled_(false)
+{
+}
+
+void PollScheduler::setRates(double active_hz, double idle_hz)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  active_period_ = 1.0 / active_hz;
+  idle_period_ = std::max(active_period_, 1.0 / idle_hz);
+  interval_ = active_period_;
+}
+
+void PollScheduler::setHoldTime(double seconds)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  hold_time_ = seconds;
+}
+
+void PollScheduler::setLinkShare(double share)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  link_share_ = std::min(1.0, std::max(0.01, share));
+}
+
+void PollScheduler::activity(Clock::time_point now)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  last_activity_ = now;
+  // Drop straight back to the active rate rather than waiting out a
+  // long idle interval
+  interval_ = active_period_;
+}
+
+void PollScheduler::completed(Clock::time_point start, Clock::time_point end, double exchange,
+                              bool moving, uint32_t byte_time_ns)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (moving)
+  {
+    last_activity_ = end;
+  }
+
+  double quiet = std::chrono::duration<double>(end - last_activity_).count();
+  if (!polled_ || quiet < hold_time_)
+  {
+    interval_ = active_period_;
+  }
+  else
+  {
+    interval_ = std::min(idle_period_, interval_ * 2);
+  }
+
+  // A poll takes at least its bytes' time on the wire, and more if the
+  // unit was slow to answer. Waiting behind a home or an await is left
+  // out, or one long command would hold polling at the idle rate.
+  double cost = std::max(exchange, POLL_BYTES * byte_time_ns * 1e-9);
+  interval_ = std::max(interval_, cost / link_share_);
+
+  last_start_ = start;
+  polled_ = true;
+}
+
+bool PollScheduler::due(Clock::time_point now) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!polled_) return true;
+  double since = std::chrono::duration<double>(now - last_start_).count();
+  return since >= interval_ - active_period_ / 4;
+}
+
+double PollScheduler::interval() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return interval_;
+}
+
+}  // namespace flir_ptu_driver
@@ -0,0 +1,424 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/**
+ * Measures the driver end to end against the simulated PTU:
+ *
+ *   ptu_benchmark [-b baud] [-l latency_ms] [-n iterations] [-m motions]
+ *                 [-j] [-c baseline.json [-t tolerance_pct]]
+ *
+ * For each of setPosition, setPositionAndSpeed, offsetPosition,
+ * sendSlavedCommands and getState polling it reports calls and commands
+ * per second over iterations back-to-back calls, with percentiles of the
+ * time from a call to its acknowledgement. The move APIs are then timed
+ * from rest over motions moves, from the call to the first poll which
+ * sees the axis off its starting count; that figure is only as fine as
+ * one poll. -j prints the results as JSON. With -c, the calls per second
+ * of each case are compared with an earlier -j output, and the exit
+ * status is 1 if any fell by more than the tolerance (default 10%).
+ */
+
+#include <flir_ptu_driver/driver.h>
+#include <flir_ptu_driver/simulator.h>
+#include <serial/serial.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using flir_ptu_driver::PTU;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+enum Api
+{
+  SET_POSITION,
+  SET_POSITION_AND_SPEED,
+  OFFSET_POSITION,
+  SLAVED_COMMANDS,
+  POLL
+};
+
+const char* apiName(Api api)
+{
+  switch (api)
+  {
+  case SET_POSITION: return "setPosition";
+  case SET_POSITION_AND_SPEED: return "setPositionAndSpeed";
+  case OFFSET_POSITION: return "offsetPosition";
+  case SLAVED_COMMANDS: return "sendSlavedCommands";
+  default: return "poll";
+  }
+}
+
+struct Percentiles
+{
+  double p50_us, p90_us, p99_us, max_us;
+};
+
+struct Result
+{
+  Api api;
+  double calls_per_sec;
+  double commands_per_sec;
+  Percentiles ack;
+  bool has_motion;
+  Percentiles motion;
+  int failures;
+};
+
+double microseconds(Clock::duration d)
+{
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+Percentiles summarize(std::vector<double>* samples)
+{
+  Percentiles p = { 0, 0, 0, 0 };
+  if (samples->empty()) return p;
+  std::sort(samples->begin(), samples->end());
+  size_t n = samples->size();
+  p.p50_us = (*samples)[n / 2];
+  p.p90_us = (*samples)[n * 90 / 100];
+  p.p99_us = (*samples)[n * 99 / 100];
+  p.max_us = (*samples)[n - 1];
+  return p;
+}
+
+/** \return exchanges recorded by the driver so far, across mnemonics */
+uint64_t commandCount(const PTU& ptu)
+{
+  std::vector<flir_ptu_driver::CommandStats::Snapshot> snapshots;
+  ptu.stats().snapshot(&snapshots);
+  uint64_t count = 0;
+  for (size_t i = 0; i < snapshots.size(); i++)
+  {
+    count += snapshots[i].count;
+  }
+  return count;
+}
+
+/** \return an angle which the driver's truncation turns back into counts */
+float radians(long counts, float resolution)
+{
+  return (counts + copysign(0.5, counts)) * resolution;
+}
+
+/**
+ * Sends one move of the pan axis to counts, with the tilt axis following
+ * at half the distance where the API moves both.
+ * \param from pan count the axis is at or heading for, for offsets
+ */
+bool move(PTU& ptu, Api api, long counts, long from)
+{
+  float pan_res = ptu.getResolution(PTU_PAN), tilt_res = ptu.getResolution(PTU_TILT);
+  switch (api)
+  {
+  case SET_POSITION:
+    return ptu.setPosition(PTU_PAN, radians(counts, pan_res));
+  case SET_POSITION_AND_SPEED:
+    return ptu.setPositionAndSpeed(radians(counts, pan_res), radians(counts / 2, tilt_res),
+                                   ptu.getMaxSpeed(PTU_PAN), ptu.getMaxSpeed(PTU_TILT));
+  case OFFSET_POSITION:
+    return ptu.offsetPosition(PTU_PAN, radians(counts - from, pan_res));
+  case SLAVED_COMMANDS:
+  {
+    std::ostringstream commands;
+    commands << "pp" << counts << ",tp" << counts / 2;
+    std::string result = ptu.sendSlavedCommands(commands.str());
+    return !result.empty() && result[0] == '*';
+  }
+  default:
+    float pan, tilt, panspeed, tiltspeed;
+    return ptu.getState(&pan, &tilt, &panspeed, &tiltspeed);
+  }
+}
+
+Result run(PTU& ptu, Api api, size_t iterations, size_t motions, long step)
+{
+  Result result;
+  result.api = api;
+  result.failures = 0;
+  result.has_motion = api != POLL;
+
+  // Settle at the origin at full speed, so every case starts alike
+  ptu.setPositionAndSpeed(0, 0, ptu.getMaxSpeed(PTU_PAN), ptu.getMaxSpeed(PTU_TILT));
+  ptu.awaitCompletion();
+
+  // Back to back, alternating targets so that every call is a real move
+  std::vector<double> acks;
+  acks.reserve(iterations);
+  uint64_t commands = commandCount(ptu);
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < iterations; i++)
+  {
+    long target = (i % 2 == 0) ? step : 0;
+    Clock::time_point before = Clock::now();
+    if (!move(ptu, api, target, target == 0 ? step : 0))
+    {
+      result.failures++;
+      continue;
+    }
+    acks.push_back(microseconds(Clock::now() - before));
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  result.calls_per_sec = acks.size() / seconds;
+  result.commands_per_sec = (commandCount(ptu) - commands) / seconds;
+  result.ack = summarize(&acks);
+
+  // From rest, until a poll sees the axis move
+  std::vector<double> starts;
+  for (size_t i = 0; i < motions && result.has_motion; i++)
+  {
+    if (!ptu.awaitCompletion())
+    {
+      result.failures++;
+      continue;
+    }
+    float pan, tilt, panspeed, tiltspeed;
+    if (!ptu.getState(&pan, &tilt, &panspeed, &tiltspeed))
+    {
+      result.failures++;
+      continue;
+    }
+    long from = lround(pan / ptu.getResolution(PTU_PAN));
+    long target = from == 0 ? step : 0;
+
+    Clock::time_point before = Clock::now();
+    if (!move(ptu, api, target, from))
+    {
+      result.failures++;
+      continue;
+    }
+    bool moved = false;
+    while (!moved && Clock::now() - before < std::chrono::seconds(5))
+    {
+      moved = ptu.getState(&pan, &tilt, &panspeed, &tiltspeed) &&
+              lround(pan / ptu.getResolution(PTU_PAN)) != from;
+    }
+    if (!moved)
+    {
+      result.failures++;
+      continue;
+    }
+    starts.push_back(microseconds(Clock::now() - before));
+  }
+  result.motion = summarize(&starts);
+  ptu.awaitCompletion();
+  return result;
+}
+
+void printTable(const std::vector<Result>& results)
+{
+  printf("%-20s %10s %10s %10s %10s %10s %12s %12s %6s\n", "api", "calls/s", "cmds/s",
+         "ack_p50", "ack_p90", "ack_p99", "motion_p50", "motion_p99", "fail");
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result& r = results[i];
+    printf("%-20s %10.1f %10.1f %10.1f %10.1f %10.1f", apiName(r.api), r.calls_per_sec,
+           r.commands_per_sec, r.ack.p50_us, r.ack.p90_us, r.ack.p99_us);
+    if (r.has_motion)
+    {
+      printf(" %12.1f %12.1f", r.motion.p50_us, r.motion.p99_us);
+    }
+    else
+    {
+      printf(" %12s %12s", "-", "-");
+    }
+    printf(" %6d\n", r.failures);
+  }
+}
+
+void printPercentiles(const char* name, const Percentiles& p)
+{
+  printf("\"%s\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}",
+         name, p.p50_us, p.p90_us, p.p99_us, p.max_us);
+}
+
+void printJson(const std::vector<Result>& results, uint32_t baud, double latency_ms,
+               size_t iterations, size_t motions)
+{
+  printf("{\n  \"baud\": %u,\n  \"latency_ms\": %.3f,\n  \"iterations\": %lu,\n  \"motions\": %lu,\n",
+         baud, latency_ms, static_cast<unsigned long>(iterations), static_cast<unsigned long>(motions));
+  printf("  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result& r = results[i];
+    printf("    {\"name\": \"%s\", \"calls_per_sec\": %.2f, \"commands_per_sec\": %.2f, ",
+           apiName(r.api), r.calls_per_sec, r.commands_per_sec);
+    printPercentiles("ack_us", r.ack);
+    printf(", ");
+    if (r.has_motion)
+    {
+      printPercentiles("motion_start_us", r.motion);
+    }
+    else
+    {
+      printf("\"motion_start_us\": null");
+    }
+    printf(", \"failures\": %d}%s\n", r.failures, i + 1 < results.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+}
+
+/**
+ * Finds the calls per second of a case in earlier -j output. Only the
+ * layout printJson writes is understood.
+ * \return false if the case is not there
+ */
+bool baselineRate(const std::string& json, const char* name, double* rate)
+{
+  std::string key = std::string("\"name\": \"") + name + "\"";
+  size_t at = json.find(key);
+  if (at == std::string::npos) return false;
+  const char field[] = "\"calls_per_sec\": ";
+  at = json.find(field, at);
+  if (at == std::string::npos) return false;
+  *rate = strtod(json.c_str() + at + sizeof(field) - 1, NULL);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  flir_ptu_driver::SimulatorOptions options;
+  options.latency = 0.001;
+  size_t iterations = 200, motions = 20;
+  bool json = false;
+  std::string baseline_path;
+  double tolerance = 10;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:l:n:m:jc:t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'b':
+      options.baud = atoi(optarg);
+      break;
+    case 'l':
+      options.latency = atof(optarg) / 1000;
+      break;
+    case 'n':
+      iterations = strtoul(optarg, NULL, 10);
+      break;
+    case 'm':
+      motions = strtoul(optarg, NULL, 10);
+      break;
+    case 'j':
+      json = true;
+      break;
+    case 'c':
+      baseline_path = optarg;
+      break;
+    case 't':
+      tolerance = atof(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-b baud] [-l latency_ms] [-n iterations] [-m motions] "
+              "[-j] [-c baseline.json [-t tolerance_pct]]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (options.baud == 0 || options.latency < 0 || iterations == 0 || tolerance < 0)
+  {
+    fprintf(stderr, "%s: baud and iterations must be positive, latency and tolerance not negative\n",
+            argv[0]);
+    return 2;
+  }
+
+  std::string baseline;
+  if (!baseline_path.empty())
+  {
+    std::ifstream in(baseline_path.c_str());
+    if (!in)
+    {
+      fprintf(stderr, "%s: cannot read %s\n", argv[0], baseline_path.c_str());
+      return 2;
+    }
+    baseline.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  flir_ptu_driver::Simulator simulator(options);
+  if (!simulator.start())
+  {
+    fprintf(stderr, "%s: unable to start the simulator\n", argv[0]);
+    return 1;
+  }
+  serial::Serial ser(simulator.port(), options.baud, serial::Timeout::simpleTimeout(1000));
+  PTU ptu(&ser);
+  if (!ptu.initialize())
+  {
+    fprintf(stderr, "%s: the simulated PTU did not initialize\n", argv[0]);
+    return 1;
+  }
+
+  // Far enough to take several polls, short enough to settle quickly
+  long step = std::max<long>(ptu.getMaxSpeed(PTU_PAN) / ptu.getResolution(PTU_PAN) / 20, 10);
+
+  const Api apis[] = { SET_POSITION, SET_POSITION_AND_SPEED, OFFSET_POSITION, SLAVED_COMMANDS, POLL };
+  std::vector<Result> results;
+  for (size_t i = 0; i < sizeof(apis) / sizeof(apis[0]); i++)
+  {
+    results.push_back(run(ptu, apis[i], iterations, motions, step));
+  }
+
+  if (json)
+  {
+    printJson(results, options.baud, options.latency * 1000, iterations, motions);
+  }
+  else
+  {
+    printTable(results);
+  }
+
+  int status = 0;
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    if (results[i].failures > 0) status = 1;
+    double rate;
+    if (baseline.empty()) continue;
+    if (!baselineRate(baseline, apiName(results[i].api), &rate))
+    {
+      fprintf(stderr, "%s: not in the baseline\n", apiName(results[i].api));
+      continue;
+    }
+    if (results[i].calls_per_sec < rate * (1 - tolerance / 100))
+    {
+      fprintf(stderr, "%s: %.1f calls/s, down from %.1f\n", apiName(results[i].api),
+              results[i].calls_per_sec, rate);
+      status = 1;
+    }
+  }
+  return status;
+}
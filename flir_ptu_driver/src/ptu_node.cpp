@@ -0,0 +1,56 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/calibration_cache.h>
+#include <flir_ptu_driver/node.h>
+#include <ros/ros.h>
+
+#include <algorithm>
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "ptu");
+  ros::NodeHandle n;
+  ros::NodeHandle pn("~");
+
+  // Dropped links are resumed in place; this loop only retries a failed
+  // connect, and the cache spares reading every unit's calibration again
+  flir_ptu_driver::CalibrationCache calibrations;
+  double backoff = PTU_RECONNECT_MIN;
+  while (ros::ok())
+  {
+    // Connect to PTU
+    flir_ptu_driver::Node ptu_node(n, pn, &calibrations);
+    ptu_node.connect();
+    if (!ptu_node.ok())
+    {
+      ROS_ERROR_STREAM("Could not connect to FLIR PTU, retrying in " << backoff << "s.");
+      ros::Duration(backoff).sleep();
+      backoff = std::min(backoff * 2, PTU_RECONNECT_MAX);
+      continue;
+    }
+    backoff = PTU_RECONNECT_MIN;
+
+    // Spin until we're in shutdown
+    ros::spin();
+  }
+
+  return 0;
+}
@@ -0,0 +1,395 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/**
+ * Replays traffic captured by TrafficRecorder (the node's ~record
+ * parameter) against a simulated PTU which answers with the delays of
+ * the recording, so latency problems seen in the field can be
+ * reproduced offline:
+ *
+ *   ptu_replay [-d | -s [-L link]] [-b baud] [-r] [-v] recording
+ *
+ * By default the recorded commands are sent again, back to back or with
+ * -r at their recorded times, and the replayed responses are compared
+ * with the recorded ones. -d prints the recording instead. -s serves the
+ * simulator until interrupted, like ptu_simulator, for ptu_node to be
+ * pointed at; its responses then cycle through the recorded delays.
+ * The link starts at the first rate noted in the recording, or at -b.
+ */
+
+#include <flir_ptu_driver/driver.h>
+#include <flir_ptu_driver/protocol.h>
+#include <flir_ptu_driver/simulator.h>
+#include <flir_ptu_driver/traffic_recorder.h>
+#include <serial/serial.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using flir_ptu_driver::TrafficRecorder;
+
+namespace
+{
+
+volatile sig_atomic_t g_stop = 0;
+
+void handleSignal(int)
+{
+  g_stop = 1;
+}
+
+/** What was written in one go, and what came back for each command. */
+struct Exchange
+{
+  uint64_t time_ns;
+  std::string tx;
+  std::vector<std::string> commands;
+  std::vector<std::string> responses;
+  std::vector<double> delays;  ///< seconds from tx to each response
+};
+
+// Commands are delimited as the unit delimits them
+std::vector<std::string> splitCommands(const std::string& data)
+{
+  std::vector<std::string> commands;
+  std::string command;
+  for (size_t i = 0; i < data.length(); i++)
+  {
+    char c = data[i];
+    if (c == ' ' || c == '\r' || c == '\n')
+    {
+      if (!command.empty()) commands.push_back(command);
+      command.clear();
+    }
+    else
+    {
+      command += c;
+    }
+  }
+  return commands;
+}
+
+// Writes of one group share a timestamp and are replayed as one
+std::vector<Exchange> exchanges(const std::vector<TrafficRecorder::Frame>& frames)
+{
+  std::vector<Exchange> result;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    const TrafficRecorder::Frame& frame = frames[i];
+    if (frame.direction == TrafficRecorder::TX)
+    {
+      if (result.empty() || result.back().time_ns != frame.time_ns || !result.back().responses.empty())
+      {
+        Exchange exchange;
+        exchange.time_ns = frame.time_ns;
+        result.push_back(exchange);
+      }
+      result.back().tx += frame.data;
+    }
+    else if (frame.direction == TrafficRecorder::RX && !result.empty())
+    {
+      Exchange& exchange = result.back();
+      exchange.responses.push_back(frame.data);
+      exchange.delays.push_back((frame.time_ns - exchange.time_ns) * 1e-9);
+    }
+  }
+  for (size_t i = 0; i < result.size(); i++)
+  {
+    result[i].commands = splitCommands(result[i].tx);
+  }
+  return result;
+}
+
+// \return true if the exchange moved the link to a new rate, set in baud
+bool changesBaud(const Exchange& exchange, uint32_t* baud)
+{
+  return exchange.commands.size() == 1 && sscanf(exchange.tx.c_str(), "@(%u,", baud) == 1 &&
+         !exchange.responses.empty() && flir_ptu_driver::protocol::isAck(exchange.responses[0]);
+}
+
+// One scripted delay per command, as the simulator answers each command
+// once. What the wire takes is left for the simulator to add, and the
+// delay of an await is the motion's, which the simulator has its own of.
+std::vector<double> latencies(const std::vector<Exchange>& exchanges, uint32_t baud)
+{
+  std::vector<double> result;
+  for (size_t i = 0; i < exchanges.size(); i++)
+  {
+    const Exchange& exchange = exchanges[i];
+    for (size_t j = 0; j < exchange.commands.size(); j++)
+    {
+      const std::string& command = exchange.commands[j];
+      if (j >= exchange.responses.size() || command == "a" || command == "r")
+      {
+        result.push_back(-1);
+        continue;
+      }
+      double wire = exchange.responses[j].length() * 10.0 / baud;
+      result.push_back(std::max(0.0, exchange.delays[j] - wire));
+    }
+    changesBaud(exchange, &baud);
+  }
+  return result;
+}
+
+std::string printable(const std::string& data)
+{
+  std::string result;
+  for (size_t i = 0; i < data.length(); i++)
+  {
+    unsigned char c = data[i];
+    if (c == '\r') result += "\\r";
+    else if (c == '\n') result += "\\n";
+    else if (c < 0x20 || c >= 0x7f)
+    {
+      char escaped[5];
+      snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+      result += escaped;
+    }
+    else result += c;
+  }
+  return result;
+}
+
+void dump(const std::vector<TrafficRecorder::Frame>& frames)
+{
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    printf("%12.6f %c %s\n", frames[i].time_ns * 1e-9, static_cast<char>(frames[i].direction),
+           printable(frames[i].data).c_str());
+  }
+}
+
+double percentile(std::vector<double> values, double q)
+{
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t index = std::min(values.size() - 1, static_cast<size_t>(q * values.size()));
+  return values[index];
+}
+
+char outcome(const std::string& response)
+{
+  if (response.empty()) return '-';
+  return (response[0] == '*' || response[0] == '!') ? response[0] : '?';
+}
+
+// Reads the response to one command, waiting out motion for those which
+// are held until it ends
+std::string readResponse(serial::Serial* ser, const std::string& command, size_t recorded_length)
+{
+  std::string response;
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+    std::chrono::seconds((command == "a" || command == "r") ? 30 : 0);
+  do
+  {
+    ser->readline(response, PTU_BUFFER_LEN);
+  }
+  while ((response.empty() || response[response.length() - 1] != '\n') &&
+         (recorded_length == 0 || response.length() < recorded_length) &&
+         std::chrono::steady_clock::now() < deadline && !g_stop);
+  return response;
+}
+
+int replay(const std::vector<Exchange>& exchanges, const std::string& port, uint32_t baud,
+           bool realtime, bool verbose)
+{
+  serial::Serial ser;
+  serial::Timeout timeout(200, 200, 0, 200, 0);
+  try
+  {
+    ser.setPort(port);
+    ser.setBaudrate(baud);
+    ser.setTimeout(timeout);
+    ser.open();
+  }
+  catch (const std::exception& e)
+  {
+    fprintf(stderr, "ptu_replay: cannot open %s: %s\n", port.c_str(), e.what());
+    return 1;
+  }
+
+  std::vector<double> recorded, replayed;
+  size_t responses = 0, missing = 0, differing = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < exchanges.size() && !g_stop; i++)
+  {
+    const Exchange& exchange = exchanges[i];
+    if (realtime)
+    {
+      std::this_thread::sleep_until(start + std::chrono::nanoseconds(exchange.time_ns - exchanges[0].time_ns));
+    }
+
+    std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+    ser.write(exchange.tx);
+    for (size_t j = 0; j < exchange.commands.size(); j++)
+    {
+      bool has_recorded = j < exchange.responses.size();
+      const std::string& command = exchange.commands[j];
+      std::string response = readResponse(&ser, command, has_recorded ? exchange.responses[j].length() : 0);
+      double delay = std::chrono::duration<double>(std::chrono::steady_clock::now() - sent).count();
+      if (response.empty()) missing++;
+      if (!has_recorded) continue;
+
+      responses++;
+      bool same = outcome(response) == outcome(exchange.responses[j]);
+      if (!same) differing++;
+      if (!response.empty())
+      {
+        recorded.push_back(exchange.delays[j]);
+        replayed.push_back(delay);
+      }
+      if (verbose || !same)
+      {
+        printf("%12.6f %-8s recorded %8.3f ms %-12s replayed %8.3f ms %s\n",
+               exchange.time_ns * 1e-9, command.c_str(),
+               exchange.delays[j] * 1e3, printable(exchange.responses[j]).c_str(),
+               delay * 1e3, printable(response).c_str());
+      }
+    }
+
+    // Follow the unit to a new rate as the driver did
+    uint32_t new_baud;
+    if (changesBaud(exchange, &new_baud))
+    {
+      ser.flush();
+      usleep(100000);
+      ser.setBaudrate(new_baud);
+      ser.flushInput();
+    }
+  }
+
+  printf("%zu exchanges, %zu responses, %zu missing, %zu with a different outcome\n",
+         exchanges.size(), responses, missing, differing);
+  printf("round trip   recorded p50 %.3f ms p99 %.3f ms max %.3f ms\n",
+         percentile(recorded, 0.5) * 1e3, percentile(recorded, 0.99) * 1e3, percentile(recorded, 1) * 1e3);
+  printf("             replayed p50 %.3f ms p99 %.3f ms max %.3f ms\n",
+         percentile(replayed, 0.5) * 1e3, percentile(replayed, 0.99) * 1e3, percentile(replayed, 1) * 1e3);
+  return (missing || differing) ? 3 : 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  bool print = false, serve = false, realtime = false, verbose = false;
+  uint32_t baud = 0;
+  std::string link;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "dsL:b:rv")) != -1)
+  {
+    switch (opt)
+    {
+    case 'b':
+      baud = atoi(optarg);
+      break;
+    case 'd':
+      print = true;
+      break;
+    case 's':
+      serve = true;
+      break;
+    case 'L':
+      link = optarg;
+      break;
+    case 'r':
+      realtime = true;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    default:
+      optind = argc;
+      break;
+    }
+  }
+  if (optind != argc - 1 || (print && serve))
+  {
+    fprintf(stderr, "usage: %s [-d | -s [-L link]] [-b baud] [-r] [-v] recording\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<TrafficRecorder::Frame> frames;
+  if (!TrafficRecorder::load(argv[optind], &frames))
+  {
+    fprintf(stderr, "%s: %s is not a PTU recording\n", argv[0], argv[optind]);
+    return 1;
+  }
+  if (print)
+  {
+    dump(frames);
+    return 0;
+  }
+
+  // The link starts at the first rate noted, or else at the one a unit
+  // powers up at
+  std::vector<Exchange> recorded = exchanges(frames);
+  flir_ptu_driver::SimulatorOptions options;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    if (frames[i].direction == TrafficRecorder::BAUD)
+    {
+      options.baud = strtoul(frames[i].data.c_str(), NULL, 10);
+      break;
+    }
+  }
+  if (baud) options.baud = baud;
+  options.latencies = latencies(recorded, options.baud);
+
+  signal(SIGINT, handleSignal);
+  signal(SIGTERM, handleSignal);
+
+  flir_ptu_driver::Simulator simulator(options);
+  if (!simulator.start()) return 1;
+
+  if (!serve)
+  {
+    return replay(recorded, simulator.port(), options.baud, realtime, verbose);
+  }
+
+  std::string port = simulator.port();
+  if (!link.empty())
+  {
+    unlink(link.c_str());
+    if (symlink(port.c_str(), link.c_str()) != 0)
+    {
+      perror("symlink");
+      return 1;
+    }
+    port = link;
+  }
+  printf("ptu: %s\n", port.c_str());
+  fflush(stdout);
+  while (!g_stop)
+  {
+    pause();
+  }
+  if (!link.empty()) unlink(link.c_str());
+  return 0;
+}
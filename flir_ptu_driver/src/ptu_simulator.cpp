@@ -0,0 +1,132 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/**
+ * Serves simulated PTUs on ptys until interrupted, printing the port of
+ * each so that ptu_node can be pointed at them:
+ *
+ *   ptu_simulator [-n count] [-b baud] [-l latency_ms] [-L link_prefix]
+ *
+ * With -L, each port is also linked as <link_prefix><index>, e.g.
+ * -L /tmp/ptu gives /tmp/ptu0, /tmp/ptu1 and so on.
+ */
+
+#include <flir_ptu_driver/simulator.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void handleSignal(int)
+{
+  g_stop = 1;
+}
+
+int main(int argc, char** argv)
+{
+  flir_ptu_driver::SimulatorOptions options;
+  int count = 1;
+  std::string link_prefix;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:b:l:L:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'n':
+      count = atoi(optarg);
+      break;
+    case 'b':
+      options.baud = atoi(optarg);
+      break;
+    case 'l':
+      options.latency = atof(optarg) / 1000;
+      break;
+    case 'L':
+      link_prefix = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n count] [-b baud] [-l latency_ms] [-L link_prefix]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (count < 1 || options.baud == 0 || options.latency < 0)
+  {
+    fprintf(stderr, "%s: count and baud must be positive, latency not negative\n", argv[0]);
+    return 2;
+  }
+
+  signal(SIGINT, handleSignal);
+  signal(SIGTERM, handleSignal);
+
+  std::vector<flir_ptu_driver::Simulator*> simulators;
+  std::vector<std::string> links;
+  int status = 0;
+  for (int i = 0; i < count && status == 0; i++)
+  {
+    flir_ptu_driver::Simulator* simulator = new flir_ptu_driver::Simulator(options);
+    simulators.push_back(simulator);
+    if (!simulator->start())
+    {
+      status = 1;
+      break;
+    }
+
+    std::string port = simulator->port();
+    if (!link_prefix.empty())
+    {
+      std::ostringstream link;
+      link << link_prefix << i;
+      unlink(link.str().c_str());
+      if (symlink(simulator->port().c_str(), link.str().c_str()) != 0)
+      {
+        perror("symlink");
+        status = 1;
+        break;
+      }
+      links.push_back(link.str());
+      port = link.str();
+    }
+    printf("ptu%d: %s\n", i, port.c_str());
+  }
+  fflush(stdout);
+
+  while (status == 0 && !g_stop)
+  {
+    pause();
+  }
+
+  for (size_t i = 0; i < links.size(); i++)
+  {
+    unlink(links[i].c_str());
+  }
+  for (size_t i = 0; i < simulators.size(); i++)
+  {
+    delete simulators[i];
+  }
+  return status;
+}
@@ -0,0 +1,176 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/ptu_state.h>
+
+#include <algorithm>
+
+namespace flir_ptu_driver
+{
+
+PTUState::PTUState()
+  : valid_(false), mode_(-1), max_horizon_(0.5)
+{
+}
+
+void PTUState::update(float pan, float tilt, float panspeed, float tiltspeed,
+                      Clock::time_point stamp)
+{
+  update(pan, tilt, panspeed, tiltspeed, stamp, stamp);
+}
+
+void PTUState::update(float pan, float tilt, float panspeed, float tiltspeed,
+                      Clock::time_point pan_stamp, Clock::time_point tilt_stamp)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  updateAxis(&pan_, pan, panspeed, pan_stamp);
+  updateAxis(&tilt_, tilt, tiltspeed, tilt_stamp);
+  valid_ = true;
+}
+
+void PTUState::updateAxis(Axis* axis, float position, float speed, Clock::time_point stamp)
+{
+  double dt = valid_ ? std::chrono::duration<double>(stamp - axis->stamp).count() : 0;
+  if (dt > 0)
+  {
+    float rate = (position - axis->position) / dt;
+    axis->acceleration = (rate - axis->rate) / dt;
+    axis->rate = rate;
+  }
+  else
+  {
+    axis->rate = 0;
+    axis->acceleration = 0;
+  }
+  axis->position = position;
+  axis->speed = speed;
+  axis->stamp = stamp;
+}
+
+void PTUState::setTarget(char type, float position)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Axis& axis = (type == PTU_TILT ? tilt_ : pan_);
+  axis.target = position;
+  axis.has_target = true;
+}
+
+void PTUState::clearTargets()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  pan_.has_target = false;
+  tilt_.has_target = false;
+}
+
+void PTUState::setMode(char mode)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  mode_ = mode;
+}
+
+char PTUState::mode() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return mode_;
+}
+
+void PTUState::setMaxHorizon(double seconds)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_horizon_ = seconds;
+}
+
+bool PTUState::predict(Clock::time_point now, Sample* sample) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!valid_)
+  {
+    sample->age = -1;
+    return false;
+  }
+
+  Clock::time_point oldest = std::min(pan_.stamp, tilt_.stamp);
+  Clock::time_point newest = std::max(pan_.stamp, tilt_.stamp);
+  sample->age = std::chrono::duration<double>(now - oldest).count();
+
+  // Both axes are brought to the same time so the sample is consistent
+  Clock::time_point horizon = newest + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double>(max_horizon_));
+  Clock::time_point target = std::max(std::min(now, horizon), newest);
+
+  sample->pan = predictAxis(pan_, std::chrono::duration<double>(target - pan_.stamp).count());
+  sample->tilt = predictAxis(tilt_, std::chrono::duration<double>(target - tilt_.stamp).count());
+  sample->panspeed = pan_.speed;
+  sample->tiltspeed = tilt_.speed;
+  sample->panrate = pan_.rate;
+  sample->tiltrate = tilt_.rate;
+  sample->pan_stamp = target;
+  sample->tilt_stamp = target;
+  return true;
+}
+
+bool PTUState::last(Sample* sample) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  sample->pan = pan_.position;
+  sample->tilt = tilt_.position;
+  sample->panspeed = pan_.speed;
+  sample->tiltspeed = tilt_.speed;
+  sample->panrate = pan_.rate;
+  sample->tiltrate = tilt_.rate;
+  sample->pan_stamp = pan_.stamp;
+  sample->tilt_stamp = tilt_.stamp;
+  sample->age = valid_ ? std::chrono::duration<double>(
+                           Clock::now() - std::min(pan_.stamp, tilt_.stamp)).count() : -1;
+  return valid_;
+}
+
+float PTUState::predictAxis(const Axis& axis, double dt) const
+{
+  double v = axis.rate;
+  double a = axis.acceleration;
+
+  // A deceleration only carries on until the axis stops. Speeding up is
+  // not carried forward; measured over one poll it overstates the ramp.
+  if (v * a < 0)
+  {
+    dt = std::min(dt, -v / a);
+  }
+  else
+  {
+    a = 0;
+  }
+
+  double p = axis.position + v * dt + 0.5 * a * dt * dt;
+
+  if (axis.has_target)
+  {
+    bool moving_up = axis.position <= axis.target;
+    if (moving_up ? p >= axis.target : p <= axis.target)
+    {
+      p = axis.target;
+    }
+  }
+
+  return p;
+}
+
+}  // namespace flir_ptu_driver
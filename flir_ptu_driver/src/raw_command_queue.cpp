@@ -0,0 +1,77 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/raw_command_queue.h>
+#include <flir_ptu_driver/protocol.h>
+
+namespace flir_ptu_driver
+{
+
+RawCommandQueue::RawCommandQueue(IOEngine* io, ResponseCallback callback)
+  : io_(io), callback_(callback), expected_(0), in_command_(false), scheduled_(false)
+{
+}
+
+bool RawCommandQueue::push(const uint8_t* data, size_t length)
+{
+  // Queued before it is counted, so a flush never waits on responses to
+  // bytes it has not written; at worst they are read by the next flush.
+  if (!io_->serial().enqueueWrite(data, length)) return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  expected_ += protocol::countCommands(reinterpret_cast<const char*>(data), length, &in_command_);
+  if (scheduled_) return true;
+  scheduled_ = true;
+  io_->post<void>(std::bind(&RawCommandQueue::flush, this, std::placeholders::_1));
+  return true;
+}
+
+void RawCommandQueue::flush(PTU& pantilt)
+{
+  size_t expected;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    expected = expected_;
+    expected_ = 0;
+    scheduled_ = false;
+  }
+
+  std::string responses;
+  try
+  {
+    responses = pantilt.sendQueuedCommands(expected);
+  }
+  catch (...)
+  {
+    // What did not go out is lost with the link, rather than sent after
+    // reconnecting
+    io_->serial().clearWrites();
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_command_ = false;
+    throw;
+  }
+
+  if (callback_)
+  {
+    callback_(responses);
+  }
+}
+
+}  // namespace flir_ptu_driver
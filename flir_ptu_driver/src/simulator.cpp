@@ -0,0 +1,494 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/driver.h>
+#include <flir_ptu_driver/protocol.h>
+#include <flir_ptu_driver/simulator.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+#include <algorithm>
+
+namespace flir_ptu_driver
+{
+
+// How often the axes are stepped while nothing arrives
+static const double SIMULATOR_TICK = 0.005;
+
+static const char ACK[] = "*\r\n";
+
+SimulatorOptions::SimulatorOptions()
+  : baud(PTU_DEFAULT_BAUD), latency(0.002)
+{
+  SimulatorAxis d46_pan = { 92.5714, -3090, 3090, 57, 2902, 2000, 500 };
+  SimulatorAxis d46_tilt = { 46.2857, -3000, 1000, 57, 2902, 2000, 500 };
+  pan = d46_pan;
+  tilt = d46_tilt;
+}
+
+Simulator::Simulator(const SimulatorOptions& options)
+  : options_(options), master_fd_(-1), slave_fd_(-1), running_(false),
+    mode_(PTU_POSITION), slaved_(false), limits_enabled_(true), baud_(options.baud),
+    responses_(0)
+{
+  Axis* axes[] = { &pan_, &tilt_ };
+  const SimulatorAxis* limits[] = { &options_.pan, &options_.tilt };
+  for (size_t i = 0; i < 2; i++)
+  {
+    axes[i]->limits = *limits[i];
+    axes[i]->position = 0;
+    axes[i]->velocity = 0;
+    axes[i]->target = 0;
+    axes[i]->speed = limits[i]->speed_max / 2;
+    axes[i]->staged_target = 0;
+    axes[i]->staged = false;
+  }
+}
+
+Simulator::~Simulator()
+{
+  stop();
+}
+
+bool Simulator::start()
+{
+  if (running_) return true;
+
+  char name[100];
+  if (openpty(&master_fd_, &slave_fd_, name, NULL, NULL) == -1)
+  {
+    perror("openpty");
+    return false;
+  }
+
+  // Keep the slave open, so the master never reads EIO between clients,
+  // and raw, so nothing is echoed before a client configures it.
+  struct termios options;
+  if (tcgetattr(slave_fd_, &options) == 0)
+  {
+    cfmakeraw(&options);
+    tcsetattr(slave_fd_, TCSANOW, &options);
+  }
+
+  port_ = name;
+  running_ = true;
+  thread_ = std::thread(&Simulator::run, this);
+  return true;
+}
+
+void Simulator::stop()
+{
+  if (!running_) return;
+
+  running_ = false;
+  thread_.join();
+  close(master_fd_);
+  close(slave_fd_);
+  master_fd_ = slave_fd_ = -1;
+}
+
+void Simulator::getPosition(long* pan, long* tilt) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  *pan = lround(pan_.position);
+  *tilt = lround(tilt_.position);
+}
+
+void Simulator::run()
+{
+  std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+  while (running_)
+  {
+    double wait = SIMULATOR_TICK;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!output_.empty())
+      {
+        double due = std::chrono::duration<double>(
+                       output_.front().due - std::chrono::steady_clock::now()).count();
+        wait = std::max(0.0, std::min(wait, due));
+      }
+    }
+
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(master_fd_, &readfds);
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = static_cast<long>(wait * 1e6);
+    int ready = select(master_fd_ + 1, &readfds, NULL, NULL, &timeout);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    step(std::chrono::duration<double>(now - last).count());
+    last = now;
+
+    if (ready > 0)
+    {
+      char buffer[256];
+      ssize_t length = read(master_fd_, buffer, sizeof(buffer));
+      if (length > 0)
+      {
+        receive(buffer, length);
+      }
+    }
+
+    // Commands after an await wait until it completes
+    while (!awaiting_.empty() && !moving())
+    {
+      respond(awaiting_.front());
+      awaiting_.pop_front();
+      receive(NULL, 0);
+    }
+    flushOutput();
+  }
+}
+
+void Simulator::step(double dt)
+{
+  stepAxis(&pan_, dt);
+  stepAxis(&tilt_, dt);
+}
+
+void Simulator::stepAxis(Axis* axis, double dt)
+{
+  double a = axis->limits.acceleration;
+  double desired;
+  if (mode_ == PTU_POSITION)
+  {
+    // Trapezoidal profile: cruise at speed, leaving room to stop
+    double remaining = axis->target - axis->position;
+    double stopping = sqrt(2 * a * fabs(remaining));
+    desired = copysign(std::min(static_cast<double>(axis->speed), stopping), remaining);
+  }
+  else
+  {
+    desired = axis->speed;
+  }
+
+  // Speeds up to the base speed are reached at once, the rest ramps
+  double base = axis->limits.base_speed;
+  if (fabs(desired) <= base)
+  {
+    axis->velocity = desired;
+  }
+  else
+  {
+    if (fabs(axis->velocity) < base && axis->velocity * desired >= 0)
+    {
+      axis->velocity = copysign(base, desired);
+    }
+    double change = desired - axis->velocity;
+    axis->velocity = fabs(change) <= a * dt ? desired : axis->velocity + copysign(a * dt, change);
+  }
+
+  double previous = axis->position;
+  axis->position += axis->velocity * dt;
+
+  if (mode_ == PTU_POSITION)
+  {
+    bool passed = (previous - axis->target) * (axis->position - axis->target) <= 0;
+    if (passed || fabs(axis->target - axis->position) < 0.5)
+    {
+      axis->position = axis->target;
+      axis->velocity = 0;
+    }
+  }
+  else if (limits_enabled_)
+  {
+    if (axis->position < axis->limits.min || axis->position > axis->limits.max)
+    {
+      axis->position = std::min<double>(std::max<double>(axis->position, axis->limits.min),
+                                        axis->limits.max);
+      axis->velocity = 0;
+    }
+  }
+}
+
+bool Simulator::moving() const
+{
+  if (mode_ != PTU_POSITION) return false;
+  return pan_.velocity != 0 || tilt_.velocity != 0 ||
+         pan_.position != pan_.target || tilt_.position != tilt_.target;
+}
+
+void Simulator::receive(const char* data, size_t length)
+{
+  if (length > 0)
+  {
+    command_.append(data, length);
+  }
+
+  size_t start = 0;
+  while (awaiting_.empty())
+  {
+    start = command_.find_first_not_of(" \r\n", start);
+    if (start == std::string::npos) break;
+    size_t end = command_.find_first_of(" \r\n", start);
+    if (end == std::string::npos) break;
+    execute(command_.substr(start, end - start));
+    start = end;
+  }
+  command_.erase(0, std::min(start, command_.size()));
+}
+
+void Simulator::execute(const std::string& command)
+{
+  if (command.compare(0, 2, "@(") == 0)
+  {
+    // The acknowledgement still goes out at the old rate
+    long baud = strtol(command.c_str() + 2, NULL, 10);
+    if (baud <= 0)
+    {
+      respond("! Illegal baud rate\r\n");
+      return;
+    }
+    respond(ACK);
+    baud_ = baud;
+    return;
+  }
+
+  if (command.length() == 1)
+  {
+    switch (command[0])
+    {
+    case 'c':
+      respond(mode_ == PTU_VELOCITY ? "* pv\r\n" : "* i\r\n");
+      return;
+    case 's':
+      slaved_ = true;
+      respond(ACK);
+      return;
+    case 'I':
+    case 'i':
+      executeStaged();
+      slaved_ = false;
+      respond(ACK);
+      return;
+    case 'a':
+      executeStaged();
+      awaiting_.push_back(ACK);
+      return;
+    case 'h':
+      for (Axis* axis : { &pan_, &tilt_ })
+      {
+        double stopping = axis->velocity * fabs(axis->velocity) / (2 * axis->limits.acceleration);
+        axis->target = lround(axis->position + stopping);
+        if (mode_ == PTU_VELOCITY) axis->speed = 0;
+      }
+      respond(ACK);
+      return;
+    case 'r':
+      // Homing sweeps both axes back to zero before reporting
+      mode_ = PTU_POSITION;
+      for (Axis* axis : { &pan_, &tilt_ })
+      {
+        axis->target = 0;
+        axis->speed = axis->limits.speed_max;
+      }
+      awaiting_.push_back("!T!T!P!P*");
+      return;
+    }
+  }
+  else if (command.length() == 2 && command[0] == 'c' &&
+           (command[1] == PTU_POSITION || command[1] == PTU_VELOCITY))
+  {
+    if (command[1] != mode_)
+    {
+      for (Axis* axis : { &pan_, &tilt_ })
+      {
+        axis->target = lround(axis->position);
+        axis->speed = command[1] == PTU_VELOCITY ? 0 : axis->limits.speed_max / 2;
+      }
+      mode_ = command[1];
+    }
+    respond(ACK);
+    return;
+  }
+  else if (command == "ft" || command == "fv" || command == "ed" || command == "ee")
+  {
+    respond(ACK);
+    return;
+  }
+  else if (command == "ld" || command == "le")
+  {
+    limits_enabled_ = command[1] == 'e';
+    respond(ACK);
+    return;
+  }
+  else if (command[0] == PTU_PAN || command[0] == PTU_TILT)
+  {
+    Axis* axis = command[0] == PTU_PAN ? &pan_ : &tilt_;
+    bool has_value = command.length() > 2;
+    long value = 0;
+    if (has_value)
+    {
+      const char* start = command.c_str() + 2;
+      char* end;
+      value = strtol(start, &end, 10);
+      if (*end != '\0' || end == start)
+      {
+        respond("! Illegal argument\r\n");
+        return;
+      }
+    }
+    respond(executeAxis(axis, command[1], has_value, value));
+    return;
+  }
+
+  respond("! Illegal command\r\n");
+}
+
+std::string Simulator::executeAxis(Axis* axis, char op, bool has_value, long value)
+{
+  char response[protocol::MAX_COMMAND_LEN + 8];
+  long* setting = NULL;
+  switch (op)
+  {
+  case 'p':
+  case 'o':
+    if (!has_value)
+    {
+      if (op == 'o') break;
+      snprintf(response, sizeof(response), "* %ld\r\n", lround(axis->position));
+      return response;
+    }
+    if (op == 'o')
+    {
+      value += (slaved_ && axis->staged) ? axis->staged_target : axis->target;
+    }
+    if (limits_enabled_ && (value < axis->limits.min || value > axis->limits.max))
+    {
+      return "! Maximum allowable position exceeded\r\n";
+    }
+    if (slaved_)
+    {
+      axis->staged_target = value;
+      axis->staged = true;
+    }
+    else
+    {
+      axis->target = value;
+    }
+    return ACK;
+  case 's':
+    if (!has_value)
+    {
+      long speed = mode_ == PTU_VELOCITY ? lround(axis->velocity) : axis->speed;
+      snprintf(response, sizeof(response), "* %ld\r\n", speed);
+      return response;
+    }
+    if (labs(value) > axis->limits.speed_max || (mode_ == PTU_POSITION && value < 0))
+    {
+      return "! Illegal speed argument\r\n";
+    }
+    axis->speed = value;
+    return ACK;
+  case 'r':
+    if (has_value) break;
+    snprintf(response, sizeof(response), "* %.4f\r\n", axis->limits.resolution);
+    return response;
+  case 'n': setting = &axis->limits.min; break;
+  case 'x': setting = &axis->limits.max; break;
+  case 'l': setting = &axis->limits.speed_min; break;
+  case 'u': setting = &axis->limits.speed_max; break;
+  case 'a': setting = &axis->limits.acceleration; break;
+  case 'b': setting = &axis->limits.base_speed; break;
+  }
+
+  if (!setting)
+  {
+    return "! Illegal command\r\n";
+  }
+  if (!has_value)
+  {
+    snprintf(response, sizeof(response), "* %ld\r\n", *setting);
+    return response;
+  }
+  if (op == 'a' && value <= 0)
+  {
+    return "! Illegal argument\r\n";
+  }
+  *setting = value;
+  return ACK;
+}
+
+void Simulator::executeStaged()
+{
+  for (Axis* axis : { &pan_, &tilt_ })
+  {
+    if (axis->staged)
+    {
+      axis->target = axis->staged_target;
+      axis->staged = false;
+    }
+  }
+}
+
+void Simulator::respond(const std::string& data)
+{
+  double latency = options_.latency;
+  if (!options_.latencies.empty())
+  {
+    double scripted = options_.latencies[responses_++ % options_.latencies.size()];
+    if (scripted >= 0) latency = scripted;
+  }
+
+  // Responses queue behind each other on the wire
+  std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(latency));
+  if (!output_.empty())
+  {
+    due = std::max(due, output_.back().due);
+  }
+  due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+           std::chrono::duration<double>(data.size() * 10.0 / baud_));
+
+  Output output = { due, data };
+  output_.push_back(output);
+}
+
+void Simulator::flushOutput()
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  while (!output_.empty() && output_.front().due <= now)
+  {
+    const std::string& data = output_.front().data;
+    if (write(master_fd_, data.data(), data.size()) < 0)
+    {
+      perror("write");
+    }
+    output_.pop_front();
+  }
+}
+
+}  // namespace flir_ptu_driver
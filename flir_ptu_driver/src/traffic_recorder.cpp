@@ -0,0 +1,196 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/traffic_recorder.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace flir_ptu_driver
+{
+
+/*
+ * File layout, in host byte order: a Header, then the ring of Slots. A
+ * frame takes one slot per 52 bytes of data, the first flagged START.
+ */
+struct TrafficRecorder::Header
+{
+  char magic[8];
+  uint32_t slot_size;
+  uint32_t slots;
+  uint64_t count;     ///< slots written, updated after each frame
+  int64_t start_ns;   ///< wall clock when opened
+  char reserved[32];
+};
+
+struct TrafficRecorder::Slot
+{
+  uint64_t time_ns;
+  uint8_t direction;
+  uint8_t flags;
+  uint16_t length;    ///< bytes of data used
+  char data[52];
+};
+
+namespace
+{
+
+const char MAGIC[8] = "PTUREC1";
+const uint8_t START = 1;
+
+}  // namespace
+
+TrafficRecorder::TrafficRecorder()
+  : header_(NULL), slots_(NULL), mapped_(0), count_(0)
+{
+}
+
+TrafficRecorder::~TrafficRecorder()
+{
+  close();
+}
+
+bool TrafficRecorder::open(const std::string& path, size_t bytes)
+{
+  close();
+  if (bytes < sizeof(Header) + sizeof(Slot)) return false;
+  size_t slots = (bytes - sizeof(Header)) / sizeof(Slot);
+  size_t size = sizeof(Header) + slots * sizeof(Slot);
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+
+  // Allocating the blocks now means a full disk fails here, rather than
+  // as a SIGBUS on some later frame
+  void* mapping = MAP_FAILED;
+  if (posix_fallocate(fd, 0, size) == 0)
+  {
+    mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (mapping == MAP_FAILED) return false;
+
+  header_ = static_cast<Header*>(mapping);
+  slots_ = reinterpret_cast<Slot*>(header_ + 1);
+  mapped_ = size;
+  count_ = 0;
+  start_ = std::chrono::steady_clock::now();
+
+  memset(header_, 0, sizeof(Header));
+  memcpy(header_->magic, MAGIC, sizeof(MAGIC));
+  header_->slot_size = sizeof(Slot);
+  header_->slots = slots;
+  header_->start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+  return true;
+}
+
+void TrafficRecorder::close()
+{
+  if (!header_) return;
+  munmap(header_, mapped_);
+  header_ = NULL;
+  slots_ = NULL;
+  mapped_ = 0;
+}
+
+void TrafficRecorder::record(Direction direction, const char* data, size_t length)
+{
+  if (!header_) return;
+  uint64_t time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start_).count();
+
+  size_t slots = header_->slots;
+  length = std::min(length, slots * sizeof(slots_->data));
+  size_t offset = 0;
+  do
+  {
+    Slot& slot = slots_[count_ % slots];
+    size_t chunk = std::min(length - offset, sizeof(slot.data));
+    slot.time_ns = time_ns;
+    slot.direction = direction;
+    slot.flags = (offset == 0) ? START : 0;
+    slot.length = chunk;
+    memcpy(slot.data, data + offset, chunk);
+    offset += chunk;
+    count_++;
+  }
+  while (offset < length);
+
+  // A reader of the live file sees the count only after the slots
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->count = count_;
+}
+
+bool TrafficRecorder::load(const std::string& path, std::vector<Frame>* frames, int64_t* start_ns)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat info;
+  void* mapping = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(Header))
+  {
+    mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd);
+  if (mapping == MAP_FAILED) return false;
+
+  const Header* header = static_cast<const Header*>(mapping);
+  const Slot* slots = reinterpret_cast<const Slot*>(header + 1);
+  bool valid = memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+               header->slot_size == sizeof(Slot) && header->slots > 0 &&
+               sizeof(Header) + header->slots * sizeof(Slot) <= static_cast<size_t>(info.st_size);
+  if (valid)
+  {
+    if (start_ns) *start_ns = header->start_ns;
+    frames->clear();
+    uint64_t count = header->count;
+    uint64_t first = (count > header->slots) ? count - header->slots : 0;
+    bool in_frame = false;
+    for (uint64_t i = first; i < count; i++)
+    {
+      const Slot& slot = slots[i % header->slots];
+      size_t length = std::min<size_t>(slot.length, sizeof(slot.data));
+      if (slot.flags & START)
+      {
+        Frame frame;
+        frame.time_ns = slot.time_ns;
+        frame.direction = static_cast<Direction>(slot.direction);
+        frames->push_back(frame);
+        in_frame = true;
+      }
+      // Continuations whose start was overwritten are dropped
+      if (in_frame)
+      {
+        frames->back().data.append(slot.data, length);
+      }
+    }
+  }
+  munmap(mapping, info.st_size);
+  return valid;
+}
+
+}  // namespace flir_ptu_driver
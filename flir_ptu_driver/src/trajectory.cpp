@@ -0,0 +1,106 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/trajectory.h>
+#include <flir_ptu_driver/protocol.h>
+#include <ros/console.h>
+
+#include <math.h>
+#include <algorithm>
+#include <sstream>
+
+namespace flir_ptu_driver
+{
+
+// Counts/second needed to cover distance in dt, within the unit's range
+static long segmentSpeed(char type, float resolution, long min_speed, long max_speed,
+                         float distance, double dt)
+{
+  if (dt <= 0) return max_speed;
+
+  long speed = lround(fabs(distance) / dt / resolution);
+  if (speed > max_speed)
+  {
+    ROS_WARN_STREAM_THROTTLE(5, "Trajectory segment needs " << speed << " counts/s on "
+                             << type << ", limited to " << max_speed);
+  }
+  return std::min(std::max(speed, min_speed), max_speed);
+}
+
+std::string planTrajectory(const Calibration& calibration, bool limits_enabled, float pan, float tilt,
+                           const std::vector<Waypoint>& waypoints,
+                           std::vector<TrajectorySegment>* segments)
+{
+  segments->clear();
+  segments->reserve(waypoints.size());
+
+  double previous_time = 0;
+  for (size_t i = 0; i < waypoints.size(); i++)
+  {
+    const Waypoint& point = waypoints[i];
+    if (point.time < previous_time)
+    {
+      std::ostringstream error;
+      error << "Waypoint " << i << " is earlier than the one before it";
+      return error.str();
+    }
+    if (limits_enabled &&
+        (point.pan < calibration.pan_min * calibration.pan_resolution ||
+         point.pan > calibration.pan_max * calibration.pan_resolution ||
+         point.tilt < calibration.tilt_min * calibration.tilt_resolution ||
+         point.tilt > calibration.tilt_max * calibration.tilt_resolution))
+    {
+      std::ostringstream error;
+      error << "Waypoint " << i << " is out of range";
+      return error.str();
+    }
+
+    double dt = point.time - previous_time;
+    TrajectorySegment segment;
+    segment.start = previous_time;
+    segment.end = point.time;
+    segment.pan = point.pan;
+    segment.tilt = point.tilt;
+
+    char command[protocol::MAX_COMMAND_LEN];
+    using protocol::Pan;
+    using protocol::Tilt;
+    protocol::formatCommand<Pan, 's'>(command, segmentSpeed(PTU_PAN, calibration.pan_resolution,
+                                                            calibration.pan_speed_min, calibration.pan_speed_max,
+                                                            point.pan - pan, dt));
+    segment.commands.push_back(command);
+    protocol::formatCommand<Tilt, 's'>(command, segmentSpeed(PTU_TILT, calibration.tilt_resolution,
+                                                             calibration.tilt_speed_min, calibration.tilt_speed_max,
+                                                             point.tilt - tilt, dt));
+    segment.commands.push_back(command);
+    protocol::formatCommand<Pan, 'p'>(command, lround(point.pan / calibration.pan_resolution));
+    segment.commands.push_back(command);
+    protocol::formatCommand<Tilt, 'p'>(command, lround(point.tilt / calibration.tilt_resolution));
+    segment.commands.push_back(command);
+
+    segments->push_back(segment);
+    pan = point.pan;
+    tilt = point.tilt;
+    previous_time = point.time;
+  }
+  return std::string();
+}
+
+}  // namespace flir_ptu_driver
@@ -0,0 +1,123 @@
+/*
+ * flir_ptu_driver ROS package
+ * Copyright (C) 2014 Mike Purvis (mpurvis@clearpathrobotics.com)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <flir_ptu_driver/motion_profile.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+using flir_ptu_driver::AxisProfile;
+using flir_ptu_driver::MovePlan;
+using flir_ptu_driver::planMove;
+using flir_ptu_driver::profileDuration;
+using flir_ptu_driver::profileSpeed;
+
+namespace
+{
+
+const double TOLERANCE = 1e-9;
+
+AxisProfile makeAxis(double base_speed, double acceleration, double min_speed, double max_speed)
+{
+  AxisProfile axis;
+  axis.base_speed = base_speed;
+  axis.acceleration = acceleration;
+  axis.min_speed = min_speed;
+  axis.max_speed = max_speed;
+  return axis;
+}
+
+}  // namespace
+
+TEST(MotionProfile, shortMoveNeverCruises)
+{
+  AxisProfile axis = makeAxis(0.1, 1.0, 0.05, 1.0);
+  // Ramping to 1.0 and back takes 0.99, so a 0.2 move turns around at
+  // sqrt(0.1^2 + 1.0 * 0.2) instead.
+  double peak = sqrt(0.01 + 0.2);
+  double duration = profileDuration(axis, 0.2, 1.0);
+  EXPECT_NEAR(duration, 2 * (peak - 0.1) / 1.0, TOLERANCE);
+  EXPECT_GT(duration, 0.2 / 1.0);
+
+  // Any commanded speed above the peak gives the same move
+  EXPECT_NEAR(profileDuration(axis, 0.2, 0.9), duration, TOLERANCE);
+  EXPECT_DOUBLE_EQ(profileSpeed(axis, 0.2, duration), 1.0);
+}
+
+TEST(MotionProfile, longMoveCruises)
+{
+  AxisProfile axis = makeAxis(0.1, 1.0, 0.05, 1.0);
+  // 0.99 of ramps, then 0.01 at 1.0
+  EXPECT_NEAR(profileDuration(axis, 1.0, 1.0), 2 * 0.9 + 0.01, TOLERANCE);
+  EXPECT_NEAR(profileDuration(axis, -1.0, 1.0), 2 * 0.9 + 0.01, TOLERANCE);
+}
+
+TEST(MotionProfile, zeroBaseSpeed)
+{
+  AxisProfile axis = makeAxis(0.0, 2.0, 0.0, 1.0);
+  EXPECT_NEAR(profileDuration(axis, 2.0, 1.0), 2 * 1.0 / 2.0 + 1.5 / 1.0, TOLERANCE);
+  EXPECT_NEAR(profileDuration(axis, 0.1, 1.0), 2 * sqrt(2.0 * 0.1) / 2.0, TOLERANCE);
+  EXPECT_NEAR(profileSpeed(axis, 2.0, profileDuration(axis, 2.0, 0.5)), 0.5, TOLERANCE);
+  EXPECT_DOUBLE_EQ(profileDuration(axis, 0.0, 1.0), 0.0);
+}
+
+TEST(MotionProfile, speedsClampToLimits)
+{
+  AxisProfile axis = makeAxis(0.1, 1.0, 0.05, 1.0);
+  EXPECT_DOUBLE_EQ(profileDuration(axis, 1.0, 5.0), profileDuration(axis, 1.0, 1.0));
+  EXPECT_DOUBLE_EQ(profileDuration(axis, 1.0, 0.01), 1.0 / 0.05);
+
+  // Too little time runs at the top speed, too much at the bottom one
+  EXPECT_DOUBLE_EQ(profileSpeed(axis, 1.0, 0.5), 1.0);
+  EXPECT_DOUBLE_EQ(profileSpeed(axis, 1.0, 100.0), 0.05);
+}
+
+TEST(MotionProfile, planSyncsAxes)
+{
+  AxisProfile axis = makeAxis(0.1, 1.0, 0.05, 1.0);
+  MovePlan plan = planMove(axis, axis, 1.0, -0.2);
+  EXPECT_NEAR(plan.duration, profileDuration(axis, 1.0, 1.0), TOLERANCE);
+  EXPECT_DOUBLE_EQ(plan.pan_speed, 1.0);
+  EXPECT_LT(plan.tilt_speed, 1.0);
+  EXPECT_NEAR(profileDuration(axis, -0.2, plan.tilt_speed), plan.duration, 1e-6);
+
+  // Slowed below the base speed, the shorter axis moves at constant speed
+  plan = planMove(axis, axis, 0.1, 1.0);
+  EXPECT_DOUBLE_EQ(plan.tilt_speed, 1.0);
+  EXPECT_NEAR(plan.pan_speed, 0.1 / plan.duration, TOLERANCE);
+  EXPECT_LT(plan.pan_speed, axis.base_speed);
+}
+
+TEST(MotionProfile, planWithOneAxisStill)
+{
+  AxisProfile pan = makeAxis(0.1, 1.0, 0.05, 1.0);
+  AxisProfile tilt = makeAxis(0.2, 2.0, 0.1, 2.0);
+  MovePlan plan = planMove(pan, tilt, 0.0, 0.5);
+  EXPECT_NEAR(plan.duration, profileDuration(tilt, 0.5, 2.0), TOLERANCE);
+  EXPECT_DOUBLE_EQ(plan.pan_speed, pan.min_speed);
+  EXPECT_DOUBLE_EQ(plan.tilt_speed, 2.0);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
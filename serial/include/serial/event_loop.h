@@ -0,0 +1,142 @@
+/*!
+ * \file serial/event_loop.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides a readiness based event loop which lets a single thread
+ * service many serial ports. It uses epoll on Linux, kqueue on OS X and the
+ * BSDs, and poll elsewhere. It is not available on Windows.
+ */
+
+#ifndef SERIAL_EVENT_LOOP_H
+#define SERIAL_EVENT_LOOP_H
+
+#if !defined(_WIN32)
+
+#include <serial/serial.h>
+
+namespace serial {
+
+/*!
+ * Dispatches readiness callbacks for any number of open Serial ports.
+ */
+class EventLoop {
+public:
+  /*!
+   * Interface for objects which are told when a port has data to read.
+   */
+  class Handler {
+  public:
+    virtual ~Handler () {}
+
+    /*! Called from EventLoop::runOnce when the port has data waiting,
+     * either in the device or already buffered by a previous readline.
+     * A port is reported again on every call for as long as data is
+     * waiting, so a handler does not have to read everything at once.
+     *
+     * \param serial The port which is ready to read.
+     */
+    virtual void
+    onReadable (Serial &serial) = 0;
+  };
+
+  /*!
+   * \throw serial::IOException
+   */
+  EventLoop ();
+
+  virtual ~EventLoop ();
+
+  /*! Registers an open port with the loop.
+   *
+   * The port must stay open and registered until it is removed. Ports
+   * may be added from any thread.
+   *
+   * \param serial The port to watch.
+   * \param handler Object to notify when the port is readable.
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::IOException
+   */
+  void
+  add (Serial &serial, Handler *handler);
+
+  /*! Unregisters a port, which must be done before it is closed.
+   *
+   * Do not remove a port from another thread while runOnce is
+   * dispatching; handlers may remove ports from within onReadable.
+   *
+   * \param serial The port to stop watching.
+   */
+  void
+  remove (Serial &serial);
+
+  /*! Waits for any registered port to become readable and dispatches its
+   * handler.
+   *
+   * \param timeout Maximum number of milliseconds to wait.
+   *
+   * \return The number of handlers called, zero on timeout or stop.
+   *
+   * \throw serial::IOException
+   */
+  size_t
+  runOnce (uint32_t timeout);
+
+  /*! Calls runOnce until stop is called. */
+  void
+  run ();
+
+  /*! Makes run return, and wakes up a runOnce in progress. Safe to call
+   * from any thread, including from within a handler. A stop made while
+   * run is not active is forgotten when run is next called, so it does
+   * not end that run at once. */
+  void
+  stop ();
+
+private:
+  // Disable copy constructors
+  EventLoop (const EventLoop&);
+  EventLoop& operator= (const EventLoop&);
+
+  // Pimpl idiom, d_pointer
+  class EventLoopImpl;
+  EventLoopImpl *pimpl_;
+
+  // Access to the file descriptor and receive buffer of a port
+  static int
+  fileDescriptor (Serial &serial);
+
+  static bool
+  hasBufferedData (Serial &serial);
+};
+
+} // namespace serial
+
+#endif // !defined(_WIN32)
+
+#endif // SERIAL_EVENT_LOOP_H
@@ -58,8 +58,9 @@ public:
   MillisecondTimer(const uint32_t millis);         
   int64_t remaining();
 
-private:
   static timespec timespec_now();
+
+private:
   timespec expiry;
 };
 
@@ -95,9 +96,15 @@ public:
   size_t
   read (uint8_t *buf, size_t size = 1);
 
+  size_t
+  readline (uint8_t *buf, size_t size, const string &eol);
+
   size_t
   write (const uint8_t *data, size_t length);
 
+  size_t
+  writev (const WriteBuffer *buffers, size_t count);
+
   void
   flush ();
 
@@ -176,6 +183,24 @@ public:
   flowcontrol_t
   getFlowcontrol () const;
 
+  void
+  setLowLatency (bool enabled);
+
+  bool
+  getLowLatency () const;
+
+  uint64_t
+  getReadTimestamp () const;
+
+  uint32_t
+  getByteTimeNs () const;
+
+  int
+  getFileDescriptor () const;
+
+  size_t
+  bufferedBytes () const;
+
   void
   readLock ();
 
@@ -191,6 +216,21 @@ public:
 protected:
   void reconfigurePort ();
 
+  // Applies or reverts the low latency settings on the open port
+  void applyLowLatency ();
+
+  // Moves up to size buffered bytes into buf, returns the number moved
+  size_t
+  drainBuffer (uint8_t *buf, size_t size);
+
+  // Reads whatever the device has ready into the receive buffer
+  size_t
+  fillBuffer ();
+
+  // Arrival time of the buffered byte at offset
+  uint64_t
+  stampAt (size_t offset) const;
+
 private:
   string port_;               // Path to the file descriptor
   int fd_;                    // The current file descriptor
@@ -208,6 +248,30 @@ private:
   stopbits_t stopbits_;       // Stop Bits
   flowcontrol_t flowcontrol_; // Flow Control
 
+  bool low_latency_;          // Favour latency over CPU time
+  bool set_async_low_latency_; // ASYNC_LOW_LATENCY was set by us
+  int saved_latency_timer_;   // Latency timer to restore in ms, or -1
+
+  // Receive buffer used by readline; bytes [rx_head_, rx_tail_) are
+  // waiting to be consumed.
+  uint8_t rx_buffer_[4096];
+  size_t rx_head_;
+  size_t rx_tail_;
+
+  // Arrival times of the chunks in the receive buffer: bytes before
+  // rx_marks_[i].end, and after the previous mark, arrived at
+  // rx_marks_[i].stamp. When the marks run out the oldest two merge,
+  // keeping the earlier time.
+  struct FillMark {
+    size_t end;
+    uint64_t stamp;
+  };
+  FillMark rx_marks_[16];
+  size_t rx_mark_count_;
+
+  uint64_t wake_stamp_;       // When select last reported data, or 0
+  uint64_t read_stamp_;       // Arrival of the data last returned
+
   // Mutex used to lock the read functions
   pthread_mutex_t read_mutex;
   // Mutex used to lock the write functions
@@ -84,9 +84,15 @@ public:
   size_t
   read (uint8_t *buf, size_t size = 1);
 
+  size_t
+  readline (uint8_t *buf, size_t size, const string &eol);
+
   size_t
   write (const uint8_t *data, size_t length);
 
+  size_t
+  writev (const WriteBuffer *buffers, size_t count);
+
   void
   flush ();
 
@@ -165,6 +171,18 @@ public:
   flowcontrol_t
   getFlowcontrol () const;
 
+  void
+  setLowLatency (bool enabled);
+
+  bool
+  getLowLatency () const;
+
+  uint64_t
+  getReadTimestamp () const;
+
+  uint32_t
+  getByteTimeNs () const;
+
   void
   readLock ();
 
@@ -193,6 +211,8 @@ private:
   bytesize_t bytesize_;       // Size of the bytes
   stopbits_t stopbits_;       // Stop Bits
   flowcontrol_t flowcontrol_; // Flow Control
+  bool low_latency_;
+  uint64_t read_stamp_;       // Arrival of the data last returned
 
   // Mutex used to lock the read functions
   HANDLE read_mutex;
@@ -0,0 +1,116 @@
+/*!
+ * \file serial/port_registry.h
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Copyright (c) 2012 William Woodall
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This keeps the list of serial ports up to date from hotplug events, so
+ * that ports can be looked up by path or by hardware identity without
+ * walking sysfs every time.
+ */
+
+#ifndef SERIAL_PORT_REGISTRY_H
+#define SERIAL_PORT_REGISTRY_H
+
+#include <string>
+#include <vector>
+
+#include <serial/serial.h>
+
+namespace serial {
+
+/*!
+ * The serial ports present on the system, as list_ports reports them.
+ *
+ * The ports are scanned once on construction. On Linux the registry then
+ * listens for kernel hotplug events on a netlink socket: a removed tty is
+ * dropped from the list directly, and an added one causes a single rescan
+ * at the next lookup, however many events came with it. Elsewhere, or if
+ * the socket cannot be opened, every refresh rescans.
+ *
+ * A registry is not thread safe; use it from one thread at a time.
+ */
+class PortRegistry {
+public:
+  PortRegistry ();
+
+  virtual ~PortRegistry ();
+
+  /*! Applies the hotplug events which arrived since the last call,
+   * without blocking. The lookups below call this themselves. */
+  void
+  refresh ();
+
+  /*! Returns every port known, ordered by path. */
+  std::vector<PortInfo>
+  ports ();
+
+  /*! Looks up a port by its path. Symbolic links, such as those under
+   * /dev/serial/by-id, are followed.
+   *
+   * \param port Path of the port.
+   * \param info Set to the port's description if it is found.
+   *
+   * \return true if the port is present.
+   */
+  bool
+  findByPort (const std::string &port, PortInfo *info);
+
+  /*! Looks up the one port whose hardware id matches an identity.
+   *
+   * \param identity Space separated fields of a hardware id, each given
+   * whole, as in "VID:PID=0403:6001" or "SNR=FT1234", or as its value
+   * alone, as in "FT1234". A port matches if it has every field.
+   * \param info Set to the port's description if exactly one matches.
+   *
+   * \return true if exactly one port matches.
+   */
+  bool
+  findByIdentity (const std::string &identity, PortInfo *info);
+
+  /*! Tells whether a hardware id matches an identity, by the rules of
+   * findByIdentity. */
+  static bool
+  matches (const std::string &hardware_id, const std::string &identity);
+
+  /*! Returns a descriptor which becomes readable when hotplug events
+   * arrive, for adding to a poll loop, or -1 if there is none. */
+  int
+  getEventFd () const;
+
+private:
+  // Disable copy constructors
+  PortRegistry (const PortRegistry&);
+  PortRegistry& operator= (const PortRegistry&);
+
+  // Pimpl idiom, d_pointer
+  class PortRegistryImpl;
+  PortRegistryImpl *pimpl_;
+};
+
+} // namespace serial
+
+#endif // SERIAL_PORT_REGISTRY_H
@@ -89,6 +89,15 @@ typedef enum {
   flowcontrol_hardware
 } flowcontrol_t;
 
+/*!
+ * One piece of a vectored write, see Serial::writev. Like struct iovec,
+ * but independent of the platform.
+ */
+struct WriteBuffer {
+  const uint8_t *data;
+  size_t size;
+};
+
 /*!
  * Structure for setting the timeout of the serial port, times are
  * in milliseconds.
@@ -401,6 +410,92 @@ public:
   size_t
   write (const std::string &data);
 
+  /*! Write several buffers to the serial port, in order, as if they were
+   * one. On unix this is a single writev call where the port can take it
+   * all, so separately built pieces of a message need not be joined first.
+   *
+   * \param buffers Array of buffers to be written.
+   *
+   * \param count Number of buffers in the array.
+   *
+   * \return A size_t representing the number of bytes actually written to
+   * the serial port.
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::SerialException
+   * \throw serial::IOException
+   */
+  size_t
+  writev (const WriteBuffer *buffers, size_t count);
+
+  /*! Queue data to be written by a later call to flushWrites.
+   *
+   * Any number of threads may queue at once. Queueing takes no lock and
+   * never touches the port, so a producer neither waits on another one nor
+   * on the port becoming writable; the cost is one allocation holding a
+   * copy of the data. Data queued by one thread goes out in the order it
+   * was queued, and each call's data goes out unbroken.
+   *
+   * \param data A const reference to the data to be queued.
+   *
+   * \param size The number of bytes to be queued.
+   *
+   * \return false if there was no memory for the copy, true otherwise.
+   */
+  bool
+  enqueueWrite (const uint8_t *data, size_t size);
+
+  /*! Queue a string to be written by a later call to flushWrites. */
+  bool
+  enqueueWrite (const std::string &data);
+
+  /*! Write out everything queued by enqueueWrite.
+   *
+   * Only one thread should flush; it takes the write lock, so queued data
+   * never interleaves with a plain write. Queued pieces are gathered into
+   * as few writev calls as possible. If the write timeout expires first,
+   * whatever is left stays queued for the next call.
+   *
+   * \param written If not NULL, the bytes written are appended to it, for
+   * callers which log their traffic.
+   *
+   * \return A size_t representing the number of bytes actually written to
+   * the serial port.
+   *
+   * \throw serial::PortNotOpenedException
+   * \throw serial::SerialException
+   * \throw serial::IOException
+   */
+  size_t
+  flushWrites (std::string *written = NULL);
+
+  /*! Returns true if queued data is waiting for flushWrites. Meant for the
+   * flushing thread: a write being queued concurrently may not show yet.
+   */
+  bool
+  hasQueuedWrites () const;
+
+  /*! Drop everything queued by enqueueWrite without writing it, such as
+   * after the port has failed. Only the flushing thread should call this.
+   */
+  void
+  clearWrites ();
+
+  /*! Declare that only one thread ever reads from the port.
+   *
+   * The read and readline functions then stop taking the read lock, which
+   * saves a mutex lock and unlock on every call. Writers are
+   * unaffected. Only switch this while nobody is reading.
+   *
+   * \param single_reader true if a single thread does all the reading.
+   */
+  void
+  setSingleReader (bool single_reader);
+
+  /*! Returns true if single reader mode is set. */
+  bool
+  getSingleReader () const;
+
   /*! Sets the serial port identifier.
    *
    * \param port A const std::string reference containing the address of the
@@ -586,6 +681,59 @@ public:
   flowcontrol_t
   getFlowcontrol () const;
 
+  /*! Trades CPU time for response time on the serial port.
+   *
+   * When enabled on Linux, the driver is asked to hand received bytes
+   * over without delay (ASYNC_LOW_LATENCY) and, for FTDI USB adapters,
+   * the adapter's latency timer is cut from its usual 16ms to 1ms. The
+   * previous latency timer is put back when this is disabled or the port
+   * is closed. Reads already return as soon as select reports data, so
+   * VMIN and VTIME stay at zero.
+   *
+   * Each setting is made on a best effort basis: adapters without them,
+   * or a latency timer the process may not write, are left as they are.
+   * This may be set before or after the port is opened. On other
+   * platforms it has no effect.
+   *
+   * \param enabled true to favour latency
+   */
+  void
+  setLowLatency (bool enabled);
+
+  /*! Gets whether low latency was asked for.
+   *
+   * \see Serial::setLowLatency
+   */
+  bool
+  getLowLatency () const;
+
+  /*! Gets the arrival time of the data most recently returned.
+   *
+   * The time is taken when select reports the first byte of a chunk, or
+   * when the chunk is read if it was already waiting, so it is not
+   * delayed by the rest of a line or by later reads. For readline it is
+   * the arrival of the line's first byte, for readlines that of the last
+   * line, and for read that of the first byte returned. Reads which
+   * return nothing leave it unchanged.
+   *
+   * \return Nanoseconds on the monotonic clock (CLOCK_MONOTONIC on
+   * Linux), or 0 if nothing has been read yet.
+   */
+  uint64_t
+  getReadTimestamp () const;
+
+  /*! Gets the time one character takes on the wire at the present
+   * settings, counting the start, parity and stop bits.
+   *
+   * This is what waitByteTimes waits per character, and lets callers
+   * budget how much traffic the link can carry.
+   *
+   * \return Nanoseconds per character, or 0 if the port has not been
+   * opened yet.
+   */
+  uint32_t
+  getByteTimeNs () const;
+
   /*! Flush the input and output buffers */
   void
   flush ();
@@ -656,10 +804,20 @@ private:
   class SerialImpl;
   SerialImpl *pimpl_;
 
+  // Needs the file descriptor and receive buffer state of the pimpl
+  friend class EventLoop;
+
   // Scoped Lock Classes
   class ScopedReadLock;
   class ScopedWriteLock;
 
+  // Read functions skip the read lock when set
+  bool single_reader_;
+
+  // Lock-free transmit queue behind enqueueWrite
+  class WriteQueue;
+  WriteQueue *write_queue_;
+
   // Read common function
   size_t
   read_ (uint8_t *buffer, size_t size);
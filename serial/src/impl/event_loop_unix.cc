@@ -0,0 +1,410 @@
+/* Copyright 2012 William Woodall and John Harrison */
+
+#if !defined(_WIN32)
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+# include <sys/epoll.h>
+# define SERIAL_EVENT_LOOP_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) \
+   || defined(__NetBSD__)
+# include <sys/types.h>
+# include <sys/event.h>
+# include <sys/time.h>
+# define SERIAL_EVENT_LOOP_KQUEUE
+#else
+# include <poll.h>
+#endif
+
+#include "serial/event_loop.h"
+#include "serial/impl/unix.h"
+
+using std::map;
+using std::vector;
+using serial::EventLoop;
+using serial::Serial;
+using serial::IOException;
+using serial::PortNotOpenedException;
+
+class EventLoop::EventLoopImpl {
+public:
+  struct Entry {
+    Serial *serial;
+    Handler *handler;
+  };
+
+  EventLoopImpl ();
+  ~EventLoopImpl ();
+
+  void add (int fd, const Entry &entry);
+  void remove (int fd);
+  // Appends the entries for the fds which became readable
+  void wait (uint32_t timeout, vector<Entry> &ready);
+  void wake ();
+  // Copies all registered entries
+  void entries (vector<Entry> &all);
+  // Checks that a port is still registered, it may have been removed by
+  // an earlier handler in the same dispatch
+  bool registered (const Serial *serial);
+
+  void setStopped (bool stopped);
+  bool stopped ();
+
+private:
+  void drainWakeup ();
+  // Closes whichever descriptors have been opened
+  void release ();
+
+  map<int, Entry> entries_;
+  bool stopped_;
+  pthread_mutex_t mutex_;
+  int wakeup_[2];  // Self-pipe used by stop to interrupt wait
+#if defined(SERIAL_EVENT_LOOP_EPOLL) || defined(SERIAL_EVENT_LOOP_KQUEUE)
+  int poller_;
+#endif
+};
+
+EventLoop::EventLoopImpl::EventLoopImpl ()
+  : stopped_ (false)
+{
+  wakeup_[0] = wakeup_[1] = -1;
+#if defined(SERIAL_EVENT_LOOP_EPOLL) || defined(SERIAL_EVENT_LOOP_KQUEUE)
+  poller_ = -1;
+#endif
+  if (::pipe (wakeup_) == -1) {
+    THROW (IOException, errno);
+  }
+  for (int i = 0; i < 2; i++) {
+    ::fcntl (wakeup_[i], F_SETFL, ::fcntl (wakeup_[i], F_GETFL) | O_NONBLOCK);
+    ::fcntl (wakeup_[i], F_SETFD, FD_CLOEXEC);
+  }
+#if defined(SERIAL_EVENT_LOOP_EPOLL)
+  poller_ = ::epoll_create (16);
+  if (poller_ == -1) {
+    int error = errno;
+    release ();
+    THROW (IOException, error);
+  }
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = wakeup_[0];
+  if (::epoll_ctl (poller_, EPOLL_CTL_ADD, wakeup_[0], &event) == -1) {
+    int error = errno;
+    release ();
+    THROW (IOException, error);
+  }
+#elif defined(SERIAL_EVENT_LOOP_KQUEUE)
+  poller_ = ::kqueue ();
+  if (poller_ == -1) {
+    int error = errno;
+    release ();
+    THROW (IOException, error);
+  }
+  struct kevent change;
+  EV_SET (&change, wakeup_[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+  if (::kevent (poller_, &change, 1, NULL, 0, NULL) == -1) {
+    int error = errno;
+    release ();
+    THROW (IOException, error);
+  }
+#endif
+  pthread_mutex_init (&mutex_, NULL);
+}
+
+EventLoop::EventLoopImpl::~EventLoopImpl ()
+{
+  release ();
+  pthread_mutex_destroy (&mutex_);
+}
+
+void
+EventLoop::EventLoopImpl::release ()
+{
+#if defined(SERIAL_EVENT_LOOP_EPOLL) || defined(SERIAL_EVENT_LOOP_KQUEUE)
+  if (poller_ != -1) {
+    ::close (poller_);
+    poller_ = -1;
+  }
+#endif
+  for (int i = 0; i < 2; i++) {
+    if (wakeup_[i] != -1) {
+      ::close (wakeup_[i]);
+      wakeup_[i] = -1;
+    }
+  }
+}
+
+void
+EventLoop::EventLoopImpl::add (int fd, const Entry &entry)
+{
+#if defined(SERIAL_EVENT_LOOP_EPOLL)
+  epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  if (::epoll_ctl (poller_, EPOLL_CTL_ADD, fd, &event) == -1) {
+    THROW (IOException, errno);
+  }
+#elif defined(SERIAL_EVENT_LOOP_KQUEUE)
+  struct kevent change;
+  EV_SET (&change, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+  if (::kevent (poller_, &change, 1, NULL, 0, NULL) == -1) {
+    THROW (IOException, errno);
+  }
+#endif
+  pthread_mutex_lock (&mutex_);
+  entries_[fd] = entry;
+  pthread_mutex_unlock (&mutex_);
+  // Let a wait in progress pick up the new port
+  wake ();
+}
+
+void
+EventLoop::EventLoopImpl::remove (int fd)
+{
+  pthread_mutex_lock (&mutex_);
+  entries_.erase (fd);
+  pthread_mutex_unlock (&mutex_);
+#if defined(SERIAL_EVENT_LOOP_EPOLL)
+  epoll_event event;  // Ignored, but must be non-NULL on old kernels
+  ::epoll_ctl (poller_, EPOLL_CTL_DEL, fd, &event);
+#elif defined(SERIAL_EVENT_LOOP_KQUEUE)
+  struct kevent change;
+  EV_SET (&change, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  ::kevent (poller_, &change, 1, NULL, 0, NULL);
+#endif
+}
+
+void
+EventLoop::EventLoopImpl::entries (vector<Entry> &all)
+{
+  pthread_mutex_lock (&mutex_);
+  for (map<int, Entry>::const_iterator it = entries_.begin ();
+       it != entries_.end (); ++it) {
+    all.push_back (it->second);
+  }
+  pthread_mutex_unlock (&mutex_);
+}
+
+bool
+EventLoop::EventLoopImpl::registered (const Serial *serial)
+{
+  bool found = false;
+  pthread_mutex_lock (&mutex_);
+  for (map<int, Entry>::const_iterator it = entries_.begin ();
+       it != entries_.end (); ++it) {
+    if (it->second.serial == serial) {
+      found = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock (&mutex_);
+  return found;
+}
+
+void
+EventLoop::EventLoopImpl::setStopped (bool stopped)
+{
+  pthread_mutex_lock (&mutex_);
+  stopped_ = stopped;
+  pthread_mutex_unlock (&mutex_);
+}
+
+bool
+EventLoop::EventLoopImpl::stopped ()
+{
+  pthread_mutex_lock (&mutex_);
+  bool stopped = stopped_;
+  pthread_mutex_unlock (&mutex_);
+  return stopped;
+}
+
+void
+EventLoop::EventLoopImpl::wait (uint32_t timeout, vector<Entry> &ready)
+{
+  vector<int> fds;
+#if defined(SERIAL_EVENT_LOOP_EPOLL)
+  epoll_event events[16];
+  int r = ::epoll_wait (poller_, events, 16, static_cast<int> (timeout));
+  if (r < 0 && errno != EINTR) {
+    THROW (IOException, errno);
+  }
+  for (int i = 0; i < r; i++) {
+    fds.push_back (events[i].data.fd);
+  }
+#elif defined(SERIAL_EVENT_LOOP_KQUEUE)
+  struct kevent events[16];
+  timespec timeout_ts;
+  timeout_ts.tv_sec = timeout / 1000;
+  timeout_ts.tv_nsec = (timeout % 1000) * 1000000;
+  int r = ::kevent (poller_, NULL, 0, events, 16, &timeout_ts);
+  if (r < 0 && errno != EINTR) {
+    THROW (IOException, errno);
+  }
+  for (int i = 0; i < r; i++) {
+    fds.push_back (static_cast<int> (events[i].ident));
+  }
+#else
+  vector<pollfd> pollfds;
+  pollfd wakeup = { wakeup_[0], POLLIN, 0 };
+  pollfds.push_back (wakeup);
+  pthread_mutex_lock (&mutex_);
+  for (map<int, Entry>::const_iterator it = entries_.begin ();
+       it != entries_.end (); ++it) {
+    pollfd port = { it->first, POLLIN, 0 };
+    pollfds.push_back (port);
+  }
+  pthread_mutex_unlock (&mutex_);
+  int r = ::poll (&pollfds[0], pollfds.size (), static_cast<int> (timeout));
+  if (r < 0 && errno != EINTR) {
+    THROW (IOException, errno);
+  }
+  for (size_t i = 0; r > 0 && i < pollfds.size (); i++) {
+    if (pollfds[i].revents != 0) {
+      fds.push_back (pollfds[i].fd);
+    }
+  }
+#endif
+
+  pthread_mutex_lock (&mutex_);
+  for (size_t i = 0; i < fds.size (); i++) {
+    if (fds[i] == wakeup_[0]) {
+      drainWakeup ();
+      continue;
+    }
+    map<int, Entry>::const_iterator it = entries_.find (fds[i]);
+    if (it != entries_.end ()) {
+      ready.push_back (it->second);
+    }
+  }
+  pthread_mutex_unlock (&mutex_);
+}
+
+void
+EventLoop::EventLoopImpl::wake ()
+{
+  char byte = 0;
+  // If the pipe is full a wakeup is already pending, which is all we need
+  ssize_t ignored = ::write (wakeup_[1], &byte, 1);
+  (void) ignored;
+}
+
+void
+EventLoop::EventLoopImpl::drainWakeup ()
+{
+  char bytes[64];
+  while (::read (wakeup_[0], bytes, sizeof (bytes)) > 0) {}
+}
+
+EventLoop::EventLoop ()
+  : pimpl_ (new EventLoopImpl ())
+{
+}
+
+EventLoop::~EventLoop ()
+{
+  delete pimpl_;
+}
+
+int
+EventLoop::fileDescriptor (Serial &serial)
+{
+  return serial.pimpl_->getFileDescriptor ();
+}
+
+bool
+EventLoop::hasBufferedData (Serial &serial)
+{
+  return serial.pimpl_->bufferedBytes () > 0;
+}
+
+void
+EventLoop::add (Serial &serial, Handler *handler)
+{
+  if (!serial.isOpen ()) {
+    throw PortNotOpenedException ("EventLoop::add");
+  }
+  EventLoopImpl::Entry entry = { &serial, handler };
+  pimpl_->add (fileDescriptor (serial), entry);
+}
+
+void
+EventLoop::remove (Serial &serial)
+{
+  pimpl_->remove (fileDescriptor (serial));
+}
+
+size_t
+EventLoop::runOnce (uint32_t timeout)
+{
+  vector<EventLoopImpl::Entry> ready;
+
+  // Data which readline left in a port's receive buffer is invisible to
+  // the kernel, so dispatch those ports without blocking.
+  vector<EventLoopImpl::Entry> all;
+  pimpl_->entries (all);
+  for (size_t i = 0; i < all.size (); i++) {
+    if (hasBufferedData (*all[i].serial)) {
+      ready.push_back (all[i]);
+    }
+  }
+
+  // A wakeup left over from add, or an interrupted wait, is not an event
+  // worth returning for, so carry on waiting out the timeout.
+  serial::MillisecondTimer timer (timeout);
+  uint32_t remaining = ready.empty () ? timeout : 0;
+  while (true) {
+    pimpl_->wait (remaining, ready);
+    if (!ready.empty () || pimpl_->stopped ()) {
+      break;
+    }
+    int64_t left = timer.remaining ();
+    if (left <= 0) {
+      break;
+    }
+    remaining = static_cast<uint32_t> (left);
+  }
+
+  size_t dispatched = 0;
+  vector<Serial*> seen;
+  for (size_t i = 0; i < ready.size (); i++) {
+    if (std::find (seen.begin (), seen.end (), ready[i].serial) != seen.end ()) {
+      continue;
+    }
+    seen.push_back (ready[i].serial);
+    if (!pimpl_->registered (ready[i].serial)) {
+      continue;
+    }
+    ready[i].handler->onReadable (*ready[i].serial);
+    dispatched++;
+  }
+  return dispatched;
+}
+
+void
+EventLoop::run ()
+{
+  // A stop from before this run, when nothing was running, is not for it
+  pimpl_->setStopped (false);
+  while (!pimpl_->stopped ()) {
+    runOnce (1000);
+  }
+  // Leave the loop ready to be run again
+  pimpl_->setStopped (false);
+}
+
+void
+EventLoop::stop ()
+{
+  pimpl_->setStopped (true);
+  pimpl_->wake ();
+}
+
+#endif // !defined(_WIN32)
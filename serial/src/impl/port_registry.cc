@@ -0,0 +1,331 @@
+/* Copyright 2012 William Woodall and John Harrison */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+# include <sys/socket.h>
+# include <sys/types.h>
+# include <unistd.h>
+# include <linux/netlink.h>
+#endif
+
+#include "serial/port_registry.h"
+
+using std::map;
+using std::multimap;
+using std::string;
+using std::vector;
+using serial::PortInfo;
+using serial::PortRegistry;
+
+namespace {
+
+// Fields of s between spaces, without empty ones
+vector<string>
+split (const string &s)
+{
+  vector<string> fields;
+  size_t start = 0;
+  while (start < s.length ()) {
+    size_t end = s.find (' ', start);
+    if (end == string::npos) {
+      end = s.length ();
+    }
+    if (end > start) {
+      fields.push_back (s.substr (start, end - start));
+    }
+    start = end + 1;
+  }
+  return fields;
+}
+
+// Path with symbolic links resolved, or unchanged if that fails
+string
+resolve (const string &path)
+{
+#if defined(_WIN32)
+  return path;
+#else
+  char resolved[PATH_MAX];
+  if (::realpath (path.c_str (), resolved) == NULL) {
+    return path;
+  }
+  return resolved;
+#endif
+}
+
+// A hardware id field matches if it is wanted whole or by its value
+bool
+field_matches (const string &field, const string &wanted)
+{
+  if (field == wanted) {
+    return true;
+  }
+  size_t eq = field.find ('=');
+  return eq != string::npos && field.compare (eq + 1, string::npos, wanted) == 0;
+}
+
+} // namespace
+
+class PortRegistry::PortRegistryImpl {
+public:
+  PortRegistryImpl ();
+  ~PortRegistryImpl ();
+
+  void refresh ();
+
+  map<string, PortInfo> ports_;      // By path
+  multimap<string, string> fields_;  // Hardware id field, or its value, to path
+  int fd_;                           // Netlink socket, or -1
+
+private:
+  void rescan ();
+  void insert (const PortInfo &info);
+  void erase (const string &path);
+  void drainEvents ();
+
+  bool stale_;                       // A rescan is due
+};
+
+PortRegistry::PortRegistryImpl::PortRegistryImpl ()
+  : fd_ (-1), stale_ (true)
+{
+#if defined(__linux__)
+  fd_ = ::socket (AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+  if (fd_ != -1) {
+    sockaddr_nl addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;  // Kernel events, not udev's rebroadcasts
+    if (::bind (fd_, reinterpret_cast<sockaddr*> (&addr), sizeof (addr)) == -1) {
+      ::close (fd_);
+      fd_ = -1;
+    }
+  }
+#endif
+  rescan ();
+}
+
+PortRegistry::PortRegistryImpl::~PortRegistryImpl ()
+{
+#if defined(__linux__)
+  if (fd_ != -1) {
+    ::close (fd_);
+  }
+#endif
+}
+
+void
+PortRegistry::PortRegistryImpl::refresh ()
+{
+  if (fd_ == -1) {
+    stale_ = true;
+  } else {
+    drainEvents ();
+  }
+  if (stale_) {
+    rescan ();
+  }
+}
+
+void
+PortRegistry::PortRegistryImpl::rescan ()
+{
+  ports_.clear ();
+  fields_.clear ();
+  vector<PortInfo> found = serial::list_ports ();
+  for (size_t i = 0; i < found.size (); i++) {
+    insert (found[i]);
+  }
+  stale_ = false;
+}
+
+void
+PortRegistry::PortRegistryImpl::insert (const PortInfo &info)
+{
+  ports_[info.port] = info;
+  vector<string> fields = split (info.hardware_id);
+  for (size_t i = 0; i < fields.size (); i++) {
+    if (fields[i] == "n/a") {
+      continue;
+    }
+    fields_.insert (std::make_pair (fields[i], info.port));
+    size_t eq = fields[i].find ('=');
+    if (eq != string::npos && eq + 1 < fields[i].length ()) {
+      fields_.insert (std::make_pair (fields[i].substr (eq + 1), info.port));
+    }
+  }
+}
+
+void
+PortRegistry::PortRegistryImpl::erase (const string &path)
+{
+  ports_.erase (path);
+  multimap<string, string>::iterator it = fields_.begin ();
+  while (it != fields_.end ()) {
+    if (it->second == path) {
+      fields_.erase (it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void
+PortRegistry::PortRegistryImpl::drainEvents ()
+{
+#if defined(__linux__)
+  char buffer[8192];
+  while (true) {
+    sockaddr_nl sender;
+    socklen_t sender_len = sizeof (sender);
+    ssize_t length = ::recvfrom (fd_, buffer, sizeof (buffer) - 1, MSG_DONTWAIT,
+                                 reinterpret_cast<sockaddr*> (&sender), &sender_len);
+    if (length < 0) {
+      if (errno == ENOBUFS) {
+        // Events were dropped, so the list can no longer be trusted
+        stale_ = true;
+        continue;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      break;  // EAGAIN: nothing more waiting
+    }
+    if (sender.nl_pid != 0) {
+      continue;  // Only the kernel is believed
+    }
+    buffer[length] = '\0';
+
+    // "action@devpath" followed by NUL separated KEY=value pairs
+    string action, subsystem, devname;
+    for (ssize_t i = strlen (buffer) + 1; i < length; i += strlen (buffer + i) + 1) {
+      const char *pair = buffer + i;
+      if (strncmp (pair, "ACTION=", 7) == 0) {
+        action = pair + 7;
+      } else if (strncmp (pair, "SUBSYSTEM=", 10) == 0) {
+        subsystem = pair + 10;
+      } else if (strncmp (pair, "DEVNAME=", 8) == 0) {
+        devname = pair + 8;
+      }
+    }
+    if (subsystem != "tty" || devname.empty ()) {
+      continue;
+    }
+    if (action == "remove") {
+      erase (devname[0] == '/' ? devname : "/dev/" + devname);
+    } else if (action == "add") {
+      stale_ = true;  // Described on the next rescan, with its siblings
+    }
+  }
+#endif
+}
+
+PortRegistry::PortRegistry ()
+  : pimpl_ (new PortRegistryImpl ())
+{
+}
+
+PortRegistry::~PortRegistry ()
+{
+  delete pimpl_;
+}
+
+void
+PortRegistry::refresh ()
+{
+  pimpl_->refresh ();
+}
+
+vector<PortInfo>
+PortRegistry::ports ()
+{
+  pimpl_->refresh ();
+  vector<PortInfo> result;
+  map<string, PortInfo>::const_iterator it;
+  for (it = pimpl_->ports_.begin (); it != pimpl_->ports_.end (); ++it) {
+    result.push_back (it->second);
+  }
+  return result;
+}
+
+bool
+PortRegistry::findByPort (const string &port, PortInfo *info)
+{
+  pimpl_->refresh ();
+  map<string, PortInfo>::const_iterator it = pimpl_->ports_.find (port);
+  if (it == pimpl_->ports_.end ()) {
+    it = pimpl_->ports_.find (resolve (port));
+  }
+  if (it == pimpl_->ports_.end ()) {
+    return false;
+  }
+  *info = it->second;
+  return true;
+}
+
+bool
+PortRegistry::findByIdentity (const string &identity, PortInfo *info)
+{
+  vector<string> wanted = split (identity);
+  if (wanted.empty ()) {
+    return false;
+  }
+  pimpl_->refresh ();
+
+  // Candidates have the first field; the rest are checked one by one
+  typedef multimap<string, string>::const_iterator Iterator;
+  std::pair<Iterator, Iterator> range = pimpl_->fields_.equal_range (wanted[0]);
+  string found;
+  for (Iterator it = range.first; it != range.second; ++it) {
+    if (it->second == found) {
+      continue;
+    }
+    const PortInfo &candidate = pimpl_->ports_[it->second];
+    if (!matches (candidate.hardware_id, identity)) {
+      continue;
+    }
+    if (!found.empty ()) {
+      return false;  // Ambiguous
+    }
+    found = it->second;
+  }
+  if (found.empty ()) {
+    return false;
+  }
+  *info = pimpl_->ports_[found];
+  return true;
+}
+
+bool
+PortRegistry::matches (const string &hardware_id, const string &identity)
+{
+  vector<string> fields = split (hardware_id);
+  vector<string> wanted = split (identity);
+  if (wanted.empty ()) {
+    return false;
+  }
+  for (size_t i = 0; i < wanted.size (); i++) {
+    bool found = false;
+    for (size_t j = 0; j < fields.size () && !found; j++) {
+      found = field_matches (fields[j], wanted[i]);
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int
+PortRegistry::getEventFd () const
+{
+  return pimpl_->fd_;
+}
@@ -11,6 +11,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <sys/signal.h>
 #include <errno.h>
 #include <paths.h>
@@ -20,6 +21,8 @@
 #include <pthread.h>
 
 #if defined(__linux__)
+# include <limits.h>
+# include <stdlib.h>
 # include <linux/serial.h>
 #endif
 
@@ -96,6 +99,13 @@ MillisecondTimer::timespec_now ()
   return time;
 }
 
+static uint64_t
+monotonic_ns ()
+{
+  timespec now (MillisecondTimer::timespec_now ());
+  return static_cast<uint64_t> (now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
 timespec
 timespec_from_ms (const uint32_t millis)
 {
@@ -110,8 +120,11 @@ Serial::SerialImpl::SerialImpl (const string &port, unsigned long baudrate,
                                 parity_t parity, stopbits_t stopbits,
                                 flowcontrol_t flowcontrol)
   : port_ (port), fd_ (-1), is_open_ (false), xonxoff_ (false), rtscts_ (false),
-    baudrate_ (baudrate), parity_ (parity),
-    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol)
+    baudrate_ (baudrate), byte_time_ns_ (0), parity_ (parity),
+    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol),
+    low_latency_ (false), set_async_low_latency_ (false),
+    saved_latency_timer_ (-1), rx_head_ (0), rx_tail_ (0), rx_mark_count_ (0),
+    wake_stamp_ (0), read_stamp_ (0)
 {
   pthread_mutex_init(&this->read_mutex, NULL);
   pthread_mutex_init(&this->write_mutex, NULL);
@@ -443,6 +456,8 @@ Serial::SerialImpl::reconfigurePort ()
   // activate settings
   ::tcsetattr (fd_, TCSANOW, &options);
 
+  applyLowLatency ();
+
   // Update byte_time_ based on the new settings.
   uint32_t bit_time_ns = 1e9 / baudrate_;
   byte_time_ns_ = bit_time_ns * (1 + bytesize_ + parity_ + stopbits_);
@@ -458,16 +473,30 @@ void
 Serial::SerialImpl::close ()
 {
   if (is_open_ == true) {
+    int ret = 0;
+    int close_errno = 0;
     if (fd_ != -1) {
-      int ret;
+      // Put back the adapter's latency timer, but keep the setting for
+      // the next open
+      bool low_latency = low_latency_;
+      low_latency_ = false;
+      applyLowLatency ();
+      low_latency_ = low_latency;
+
+      // Linux releases the descriptor even when close fails, e.g. with
+      // EIO from an adapter that has gone away, so the port counts as
+      // closed either way and can be opened again.
       ret = ::close (fd_);
-      if (ret == 0) {
-        fd_ = -1;
-      } else {
-        THROW (IOException, errno);
-      }
+      close_errno = errno;
+      fd_ = -1;
     }
+    rx_head_ = rx_tail_ = 0;
+    rx_mark_count_ = 0;
+    wake_stamp_ = 0;
     is_open_ = false;
+    if (ret != 0) {
+      THROW (IOException, close_errno);
+    }
   }
 }
 
@@ -487,13 +516,17 @@ Serial::SerialImpl::available ()
   if (-1 == ioctl (fd_, TIOCINQ, &count)) {
       THROW (IOException, errno);
   } else {
-      return static_cast<size_t> (count);
+      return static_cast<size_t> (count) + (rx_tail_ - rx_head_);
   }
 }
 
 bool
 Serial::SerialImpl::waitReadable (uint32_t timeout)
 {
+  // Bytes already in the receive buffer can be read straight away
+  if (rx_head_ != rx_tail_) {
+    return true;
+  }
   // Setup a select call to block for serial data or a timeout
   fd_set readfds;
   FD_ZERO (&readfds);
@@ -518,7 +551,10 @@ Serial::SerialImpl::waitReadable (uint32_t timeout)
     THROW (IOException, "select reports ready to read, but our fd isn't"
            " in the list, this shouldn't happen!");
   }
-  // Data available to read.
+  // Data available to read; this is as close to its arrival as we get
+  if (wake_stamp_ == 0) {
+    wake_stamp_ = monotonic_ns ();
+  }
   return true;
 }
 
@@ -543,12 +579,25 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
   total_timeout_ms += timeout_.read_timeout_multiplier * static_cast<long> (size);
   MillisecondTimer total_timeout(total_timeout_ms);
 
+  // Hand out anything left in the receive buffer by readline first
+  if (rx_head_ != rx_tail_) {
+    read_stamp_ = stampAt (rx_head_);
+  }
+  bytes_read = drainBuffer (buf, size);
+  if (bytes_read == size) {
+    return bytes_read;
+  }
+
   // Pre-fill buffer with available bytes
   {
-    ssize_t bytes_read_now = ::read (fd_, buf, size);
+    ssize_t bytes_read_now = ::read (fd_, buf + bytes_read, size - bytes_read);
     if (bytes_read_now > 0) {
-      bytes_read = bytes_read_now;
+      if (bytes_read == 0) {
+        read_stamp_ = wake_stamp_ != 0 ? wake_stamp_ : monotonic_ns ();
+      }
+      bytes_read += bytes_read_now;
     }
+    wake_stamp_ = 0;
   }
 
   while (bytes_read < size) {
@@ -585,6 +634,10 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
         throw SerialException ("device reports readiness to read but "
                                "returned no data (device disconnected?)");
       }
+      if (bytes_read == 0) {
+        read_stamp_ = wake_stamp_ != 0 ? wake_stamp_ : monotonic_ns ();
+      }
+      wake_stamp_ = 0;
       // Update bytes_read
       bytes_read += static_cast<size_t> (bytes_read_now);
       // If bytes_read == size then we have read everything we need
@@ -606,90 +659,273 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
   return bytes_read;
 }
 
+size_t
+Serial::SerialImpl::readline (uint8_t *buf, size_t size, const string &eol)
+{
+  // If the port is not open, throw
+  if (!is_open_) {
+    throw PortNotOpenedException ("Serial::readline");
+  }
+  size_t eol_len = eol.length ();
+  const uint8_t *eol_ = reinterpret_cast<const uint8_t*> (eol.data ());
+  size_t read_so_far = 0;
+
+  while (read_so_far < size) {
+    if (rx_head_ == rx_tail_ && fillBuffer () == 0) {
+      // Wait as long as a single byte read would, then take everything
+      // the device has in one go.
+      long total_timeout_ms = timeout_.read_timeout_constant;
+      total_timeout_ms += timeout_.read_timeout_multiplier;
+      MillisecondTimer total_timeout(total_timeout_ms);
+      bool readable = false;
+      while (!readable) {
+        int64_t timeout_remaining_ms = total_timeout.remaining();
+        if (timeout_remaining_ms <= 0) {
+          break;
+        }
+        uint32_t timeout = std::min(static_cast<uint32_t> (timeout_remaining_ms),
+                                    timeout_.inter_byte_timeout);
+        readable = waitReadable(timeout);
+      }
+      if (!readable) {
+        break; // Timed out
+      }
+      if (fillBuffer () == 0) {
+        // Disconnected devices, at least on Linux, show the
+        // behavior that they are always ready to read immediately
+        // but reading returns nothing.
+        throw SerialException ("device reports readiness to read but "
+                               "returned no data (device disconnected?)");
+      }
+    }
+
+    // Copy out as much as could belong to this line, then look for the EOL
+    // in the newly copied bytes. Only the bytes up to and including the
+    // EOL are consumed from the receive buffer.
+    size_t chunk = std::min (rx_tail_ - rx_head_, size - read_so_far);
+    if (read_so_far == 0 && chunk != 0) {
+      read_stamp_ = stampAt (rx_head_);
+    }
+    memcpy (buf + read_so_far, rx_buffer_ + rx_head_, chunk);
+    size_t line_end = 0;
+    if (eol_len == 0) {
+      line_end = read_so_far + 1;
+    } else {
+      uint8_t eol_last = eol_[eol_len - 1];
+      uint8_t *search = buf + read_so_far;
+      uint8_t *end = buf + read_so_far + chunk;
+      while (search < end) {
+        uint8_t *hit = static_cast<uint8_t*> (memchr (search, eol_last, end - search));
+        if (hit == NULL) {
+          break;
+        }
+        size_t length = static_cast<size_t> (hit - buf) + 1;
+        if (length >= eol_len &&
+            memcmp (buf + length - eol_len, eol_, eol_len) == 0) {
+          line_end = length;
+          break;
+        }
+        search = hit + 1;
+      }
+    }
+    if (line_end != 0) {
+      rx_head_ += line_end - read_so_far;
+      read_so_far = line_end;
+      break; // EOL found
+    }
+    rx_head_ += chunk;
+    read_so_far += chunk;
+  }
+  if (rx_head_ == rx_tail_) {
+    rx_head_ = rx_tail_ = 0;
+    rx_mark_count_ = 0;
+  }
+  return read_so_far;
+}
+
+size_t
+Serial::SerialImpl::drainBuffer (uint8_t *buf, size_t size)
+{
+  size_t count = std::min (rx_tail_ - rx_head_, size);
+  memcpy (buf, rx_buffer_ + rx_head_, count);
+  rx_head_ += count;
+  if (rx_head_ == rx_tail_) {
+    rx_head_ = rx_tail_ = 0;
+    rx_mark_count_ = 0;
+  }
+  return count;
+}
+
+size_t
+Serial::SerialImpl::fillBuffer ()
+{
+  // Make room at the end of the buffer by moving unread bytes to the front
+  if (rx_head_ != 0) {
+    memmove (rx_buffer_, rx_buffer_ + rx_head_, rx_tail_ - rx_head_);
+    size_t kept = 0;
+    for (size_t i = 0; i < rx_mark_count_; i++) {
+      if (rx_marks_[i].end > rx_head_) {
+        rx_marks_[kept] = rx_marks_[i];
+        rx_marks_[kept].end -= rx_head_;
+        kept++;
+      }
+    }
+    rx_mark_count_ = kept;
+    rx_tail_ -= rx_head_;
+    rx_head_ = 0;
+  }
+  if (rx_tail_ == sizeof (rx_buffer_)) {
+    return 0;
+  }
+  ssize_t bytes_read_now =
+    ::read (fd_, rx_buffer_ + rx_tail_, sizeof (rx_buffer_) - rx_tail_);
+  uint64_t stamp = wake_stamp_ != 0 ? wake_stamp_ : monotonic_ns ();
+  wake_stamp_ = 0;
+  if (bytes_read_now < 1) {
+    return 0;
+  }
+  rx_tail_ += static_cast<size_t> (bytes_read_now);
+
+  const size_t max_marks = sizeof (rx_marks_) / sizeof (rx_marks_[0]);
+  if (rx_mark_count_ == max_marks) {
+    rx_marks_[1].stamp = rx_marks_[0].stamp;
+    memmove (rx_marks_, rx_marks_ + 1, (max_marks - 1) * sizeof (FillMark));
+    rx_mark_count_--;
+  }
+  rx_marks_[rx_mark_count_].end = rx_tail_;
+  rx_marks_[rx_mark_count_].stamp = stamp;
+  rx_mark_count_++;
+  return static_cast<size_t> (bytes_read_now);
+}
+
+uint64_t
+Serial::SerialImpl::stampAt (size_t offset) const
+{
+  for (size_t i = 0; i < rx_mark_count_; i++) {
+    if (offset < rx_marks_[i].end) {
+      return rx_marks_[i].stamp;
+    }
+  }
+  return read_stamp_;
+}
+
 size_t
 Serial::SerialImpl::write (const uint8_t *data, size_t length)
+{
+  WriteBuffer buffer = { data, length };
+  return writev (&buffer, 1);
+}
+
+size_t
+Serial::SerialImpl::writev (const WriteBuffer *buffers, size_t count)
 {
   if (is_open_ == false) {
     throw PortNotOpenedException ("Serial::write");
   }
   fd_set writefds;
+  size_t length = 0;
+  for (size_t i = 0; i < count; i++) {
+    length += buffers[i].size;
+  }
   size_t bytes_written = 0;
+  // First unwritten byte, as a buffer index and an offset into it
+  size_t index = 0;
+  size_t offset = 0;
 
   // Calculate total timeout in milliseconds t_c + (t_m * N)
   long total_timeout_ms = timeout_.write_timeout_constant;
   total_timeout_ms += timeout_.write_timeout_multiplier * static_cast<long> (length);
   MillisecondTimer total_timeout(total_timeout_ms);
 
+  // The port is usually ready, so write before waiting for it
+  bool selected = false;
   bool first_iteration = true;
   while (bytes_written < length) {
-    int64_t timeout_remaining_ms = total_timeout.remaining();
-    // Only consider the timeout if it's not the first iteration of the loop
-    // otherwise a timeout of 0 won't be allowed through
-    if (!first_iteration && (timeout_remaining_ms <= 0)) {
-      // Timed out
-      break;
-    }
-    first_iteration = false;
+    if (selected) {
+      int64_t timeout_remaining_ms = total_timeout.remaining();
+      // Only consider the timeout if it's not the first iteration of the loop
+      // otherwise a timeout of 0 won't be allowed through
+      if (!first_iteration && (timeout_remaining_ms <= 0)) {
+        // Timed out
+        break;
+      }
+      first_iteration = false;
 
-    timespec timeout(timespec_from_ms(timeout_remaining_ms));
+      timespec timeout(timespec_from_ms(timeout_remaining_ms));
 
-    FD_ZERO (&writefds);
-    FD_SET (fd_, &writefds);
+      FD_ZERO (&writefds);
+      FD_SET (fd_, &writefds);
 
-    // Do the select
-    int r = pselect (fd_ + 1, NULL, &writefds, NULL, &timeout, NULL);
+      // Do the select
+      int r = pselect (fd_ + 1, NULL, &writefds, NULL, &timeout, NULL);
 
-    // Figure out what happened by looking at select's response 'r'
-    /** Error **/
-    if (r < 0) {
-      // Select was interrupted, try again
-      if (errno == EINTR) {
-        continue;
-      }
-      // Otherwise there was some error
-      THROW (IOException, errno);
-    }
-    /** Timeout **/
-    if (r == 0) {
-      break;
-    }
-    /** Port ready to write **/
-    if (r > 0) {
-      // Make sure our file descriptor is in the ready to write list
-      if (FD_ISSET (fd_, &writefds)) {
-        // This will write some
-        ssize_t bytes_written_now =
-          ::write (fd_, data + bytes_written, length - bytes_written);
-        // write should always return some data as select reported it was
-        // ready to write when we get to this point.
-        if (bytes_written_now < 1) {
-          // Disconnected devices, at least on Linux, show the
-          // behavior that they are always ready to write immediately
-          // but writing returns nothing.
-          throw SerialException ("device reports readiness to write but "
-                                 "returned no data (device disconnected?)");
-        }
-        // Update bytes_written
-        bytes_written += static_cast<size_t> (bytes_written_now);
-        // If bytes_written == size then we have written everything we need to
-        if (bytes_written == length) {
-          break;
-        }
-        // If bytes_written < size then we have more to write
-        if (bytes_written < length) {
+      // Figure out what happened by looking at select's response 'r'
+      /** Error **/
+      if (r < 0) {
+        // Select was interrupted, try again
+        if (errno == EINTR) {
           continue;
         }
-        // If bytes_written > size then we have over written, which shouldn't happen
-        if (bytes_written > length) {
-          throw SerialException ("write over wrote, too many bytes where "
-                                 "written, this shouldn't happen, might be "
-                                 "a logical error!");
-        }
+        // Otherwise there was some error
+        THROW (IOException, errno);
+      }
+      /** Timeout **/
+      if (r == 0) {
+        break;
       }
       // This shouldn't happen, if r > 0 our fd has to be in the list!
-      THROW (IOException, "select reports ready to write, but our fd isn't"
-                          " in the list, this shouldn't happen!");
+      if (!FD_ISSET (fd_, &writefds)) {
+        THROW (IOException, "select reports ready to write, but our fd isn't"
+                            " in the list, this shouldn't happen!");
+      }
     }
+
+    // Gather as much of what is left as one call will take
+    iovec iov[16];
+    int iovcnt = 0;
+    for (size_t i = index; i < count && iovcnt < 16; i++) {
+      size_t skip = (i == index) ? offset : 0;
+      if (buffers[i].size == skip) {
+        continue;
+      }
+      iov[iovcnt].iov_base = const_cast<uint8_t*> (buffers[i].data) + skip;
+      iov[iovcnt].iov_len = buffers[i].size - skip;
+      iovcnt++;
+    }
+
+    ssize_t bytes_written_now = ::writev (fd_, iov, iovcnt);
+    if (bytes_written_now < 1) {
+      if (!selected) {
+        // Not ready after all, wait for it
+        selected = true;
+        continue;
+      }
+      if (bytes_written_now < 0 && errno == EINTR) {
+        continue;
+      }
+      // Disconnected devices, at least on Linux, show the
+      // behavior that they are always ready to write immediately
+      // but writing returns nothing.
+      throw SerialException ("device reports readiness to write but "
+                             "returned no data (device disconnected?)");
+    }
+    // Update bytes_written
+    bytes_written += static_cast<size_t> (bytes_written_now);
+    // If bytes_written > size then we have over written, which shouldn't happen
+    if (bytes_written > length) {
+      throw SerialException ("write over wrote, too many bytes where "
+                             "written, this shouldn't happen, might be "
+                             "a logical error!");
+    }
+    size_t advance = static_cast<size_t> (bytes_written_now);
+    while (index < count && advance >= buffers[index].size - offset) {
+      advance -= buffers[index].size - offset;
+      index++;
+      offset = 0;
+    }
+    offset += advance;
+    // Anything left is waited for, as the port must be full
+    selected = true;
   }
   return bytes_written;
 }
@@ -788,6 +1024,100 @@ Serial::SerialImpl::getFlowcontrol () const
   return flowcontrol_;
 }
 
+void
+Serial::SerialImpl::setLowLatency (bool enabled)
+{
+  low_latency_ = enabled;
+  if (is_open_)
+    applyLowLatency ();
+}
+
+bool
+Serial::SerialImpl::getLowLatency () const
+{
+  return low_latency_;
+}
+
+#if defined(__linux__)
+// The latency_timer attribute of a USB serial adapter, found through
+// sysfs the same way list_ports does, or empty if the port has none.
+static string
+latency_timer_path (const string &port)
+{
+  char resolved[PATH_MAX];
+  if (::realpath (port.c_str (), resolved) == NULL)
+    return string ();
+  string name (resolved);
+  size_t slash = name.rfind ('/');
+  if (slash != string::npos)
+    name = name.substr (slash + 1);
+  string path = "/sys/class/tty/" + name + "/device/latency_timer";
+  if (::access (path.c_str (), F_OK) != 0)
+    return string ();
+  return path;
+}
+
+static int
+read_latency_timer (const string &path)
+{
+  FILE *file = fopen (path.c_str (), "r");
+  if (file == NULL)
+    return -1;
+  int value = -1;
+  if (fscanf (file, "%d", &value) != 1)
+    value = -1;
+  fclose (file);
+  return value;
+}
+
+static bool
+write_latency_timer (const string &path, int value)
+{
+  FILE *file = fopen (path.c_str (), "w");
+  if (file == NULL)
+    return false;
+  bool ok = fprintf (file, "%d", value) > 0;
+  return (fclose (file) == 0) && ok;
+}
+#endif
+
+void
+Serial::SerialImpl::applyLowLatency ()
+{
+#if defined(__linux__)
+# if defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+  // Not every tty driver has these, so failing to get or set is fine.
+  // Only a flag set here is cleared again.
+  struct serial_struct ser;
+  if (low_latency_ != set_async_low_latency_ &&
+      ioctl (fd_, TIOCGSERIAL, &ser) == 0) {
+    if (low_latency_ && !(ser.flags & ASYNC_LOW_LATENCY)) {
+      ser.flags |= ASYNC_LOW_LATENCY;
+      set_async_low_latency_ = ioctl (fd_, TIOCSSERIAL, &ser) == 0;
+    } else if (!low_latency_) {
+      ser.flags &= ~ASYNC_LOW_LATENCY;
+      ioctl (fd_, TIOCSSERIAL, &ser);
+      set_async_low_latency_ = false;
+    }
+  }
+# endif
+
+  if (low_latency_ == (saved_latency_timer_ != -1))
+    return;  // Latency timer already as asked
+  string path = latency_timer_path (port_);
+  if (path.empty ())
+    return;
+  if (low_latency_) {
+    int current = read_latency_timer (path);
+    if (current > 1 && write_latency_timer (path, 1))
+      saved_latency_timer_ = current;
+  } else {
+    write_latency_timer (path, saved_latency_timer_);
+    saved_latency_timer_ = -1;
+  }
+#endif
+}
+
 void
 Serial::SerialImpl::flush ()
 {
@@ -803,6 +1133,9 @@ Serial::SerialImpl::flushInput ()
   if (is_open_ == false) {
     throw PortNotOpenedException ("Serial::flushInput");
   }
+  rx_head_ = rx_tail_ = 0;
+  rx_mark_count_ = 0;
+  wake_stamp_ = 0;
   tcflush (fd_, TCIFLUSH);
 }
 
@@ -1027,6 +1360,30 @@ Serial::SerialImpl::getCD ()
   }
 }
 
+int
+Serial::SerialImpl::getFileDescriptor () const
+{
+  return fd_;
+}
+
+uint64_t
+Serial::SerialImpl::getReadTimestamp () const
+{
+  return read_stamp_;
+}
+
+uint32_t
+Serial::SerialImpl::getByteTimeNs () const
+{
+  return byte_time_ns_;
+}
+
+size_t
+Serial::SerialImpl::bufferedBytes () const
+{
+  return rx_tail_ - rx_head_;
+}
+
 void
 Serial::SerialImpl::readLock ()
 {
@@ -20,6 +20,17 @@ using serial::SerialException;
 using serial::PortNotOpenedException;
 using serial::IOException;
 
+// Nanoseconds on the performance counter, which is monotonic
+static uint64_t
+monotonic_ns ()
+{
+  LARGE_INTEGER frequency, count;
+  QueryPerformanceFrequency (&frequency);
+  QueryPerformanceCounter (&count);
+  return static_cast<uint64_t> (count.QuadPart / frequency.QuadPart) * 1000000000ULL +
+    static_cast<uint64_t> (count.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+}
+
 inline wstring
 _prefix_port_if_needed(const wstring &input)
 {
@@ -37,7 +48,8 @@ Serial::SerialImpl::SerialImpl (const string &port, unsigned long baudrate,
                                 flowcontrol_t flowcontrol)
   : port_ (port.begin(), port.end()), fd_ (INVALID_HANDLE_VALUE), is_open_ (false),
     baudrate_ (baudrate), parity_ (parity),
-    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol)
+    bytesize_ (bytesize), stopbits_ (stopbits), flowcontrol_ (flowcontrol),
+    low_latency_ (false), read_stamp_ (0)
 {
   if (port_.empty () == false)
     open ();
@@ -339,9 +351,40 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
     ss << "Error while reading from the serial port: " << GetLastError();
     THROW (IOException, ss.str().c_str());
   }
+  if (bytes_read > 0) {
+    read_stamp_ = monotonic_ns ();
+  }
   return (size_t) (bytes_read);
 }
 
+size_t
+Serial::SerialImpl::readline (uint8_t *buf, size_t size, const string &eol)
+{
+  // Overlapped reads are not used on Windows, so there is no receive
+  // buffer to search: read one byte at a time and compare against the EOL.
+  size_t eol_len = eol.length ();
+  size_t read_so_far = 0;
+  uint64_t first_stamp = read_stamp_;
+  while (read_so_far < size)
+  {
+    size_t bytes_read = this->read (buf + read_so_far, 1);
+    if (read_so_far == 0) {
+      first_stamp = read_stamp_;
+    }
+    read_so_far += bytes_read;
+    read_stamp_ = first_stamp;
+    if (bytes_read == 0) {
+      break; // Timeout occured on reading 1 byte
+    }
+    if (read_so_far >= eol_len &&
+        string (reinterpret_cast<const char*>
+         (buf + read_so_far - eol_len), eol_len) == eol) {
+      break; // EOL found
+    }
+  }
+  return read_so_far;
+}
+
 size_t
 Serial::SerialImpl::write (const uint8_t *data, size_t length)
 {
@@ -357,6 +400,21 @@ Serial::SerialImpl::write (const uint8_t *data, size_t length)
   return (size_t) (bytes_written);
 }
 
+size_t
+Serial::SerialImpl::writev (const WriteBuffer *buffers, size_t count)
+{
+  // No gathering WriteFile for serial handles, so write each in turn
+  size_t bytes_written = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t bytes_written_now = write (buffers[i].data, buffers[i].size);
+    bytes_written += bytes_written_now;
+    if (bytes_written_now < buffers[i].size) {
+      break;
+    }
+  }
+  return bytes_written;
+}
+
 void
 Serial::SerialImpl::setPort (const string &port)
 {
@@ -459,6 +517,39 @@ Serial::SerialImpl::getFlowcontrol () const
   return flowcontrol_;
 }
 
+void
+Serial::SerialImpl::setLowLatency (bool enabled)
+{
+  // Nothing to tune here; remembered so getLowLatency reports it
+  low_latency_ = enabled;
+}
+
+bool
+Serial::SerialImpl::getLowLatency () const
+{
+  return low_latency_;
+}
+
+uint64_t
+Serial::SerialImpl::getReadTimestamp () const
+{
+  return read_stamp_;
+}
+
+uint32_t
+Serial::SerialImpl::getByteTimeNs () const
+{
+  if (!is_open_ || baudrate_ == 0)
+    return 0;
+  // One start bit, the data bits, a parity bit if any, and the stop bits
+  double bits = 1 + bytesize_ + (parity_ == parity_none ? 0 : 1);
+  if (stopbits_ == stopbits_one_point_five)
+    bits += 1.5;
+  else
+    bits += stopbits_;
+  return static_cast<uint32_t> (bits * 1e9 / baudrate_);
+}
+
 void
 Serial::SerialImpl::flush ()
 {
@@ -1,5 +1,7 @@
 /* Copyright 2012 William Woodall and John Harrison */
 #include <algorithm>
+#include <cstddef>
+#include <cstdlib>
 
 #if !defined(_WIN32) && !defined(__OpenBSD__) && !defined(__FreeBSD__)
 # include <alloca.h>
@@ -11,6 +13,10 @@
 
 #include "serial/serial.h"
 
+#if defined (_MSC_VER)
+# include <intrin.h>
+#endif
+
 #ifdef _WIN32
 #include "serial/impl/win.h"
 #else
@@ -34,11 +40,15 @@ using serial::flowcontrol_t;
 
 class Serial::ScopedReadLock {
 public:
-  ScopedReadLock(SerialImpl *pimpl) : pimpl_(pimpl) {
-    this->pimpl_->readLock();
+  // Takes no lock when enabled is false, for single reader mode
+  ScopedReadLock(SerialImpl *pimpl, bool enabled = true)
+   : pimpl_(enabled ? pimpl : NULL) {
+    if (this->pimpl_)
+      this->pimpl_->readLock();
   }
   ~ScopedReadLock() {
-    this->pimpl_->readUnlock();
+    if (this->pimpl_)
+      this->pimpl_->readUnlock();
   }
 private:
   // Disable copy constructors
@@ -63,17 +73,233 @@ private:
   SerialImpl *pimpl_;
 };
 
+namespace {
+
+// The few atomic operations the write queue needs on a pointer. C++03 has
+// no std::atomic, so these map onto the compiler builtins.
+#if defined (_MSC_VER)
+template <typename T> inline T *
+atomic_exchange (T * volatile *target, T *value)
+{
+  return static_cast<T *> (_InterlockedExchangePointer (
+    reinterpret_cast<void * volatile *> (target), value));
+}
+
+template <typename T> inline T *
+atomic_load_acquire (T * volatile const *source)
+{
+  T *value = *source;
+  _ReadWriteBarrier ();
+  return value;
+}
+
+template <typename T> inline void
+atomic_store_release (T * volatile *target, T *value)
+{
+  _ReadWriteBarrier ();
+  *target = value;
+}
+#else
+template <typename T> inline T *
+atomic_exchange (T * volatile *target, T *value)
+{
+  return __atomic_exchange_n (target, value, __ATOMIC_ACQ_REL);
+}
+
+template <typename T> inline T *
+atomic_load_acquire (T * volatile const *source)
+{
+  return __atomic_load_n (source, __ATOMIC_ACQUIRE);
+}
+
+template <typename T> inline void
+atomic_store_release (T * volatile *target, T *value)
+{
+  __atomic_store_n (target, value, __ATOMIC_RELEASE);
+}
+#endif
+
+} // namespace
+
+/*
+ * Intrusive multiple producer, single consumer queue, after Dmitry Vyukov.
+ * A push is one atomic exchange on the head and never waits for anything,
+ * not even another producer. Each node carries its own copy of the data,
+ * so a push costs one allocation. Popping is for one thread at a time: the
+ * one calling Serial::flushWrites, which holds the write lock throughout.
+ */
+class Serial::WriteQueue {
+public:
+  WriteQueue () : head_(&stub_), tail_(&stub_), pending_count_(0),
+                  pending_offset_(0) {
+    stub_.next = NULL;
+    stub_.size = 0;
+  }
+
+  ~WriteQueue () {
+    clear ();
+  }
+
+  // Consumer side only, like flush
+  void
+  clear () {
+    for (size_t i = 0; i < pending_count_; ++i)
+      std::free (pending_[i]);
+    pending_count_ = 0;
+    pending_offset_ = 0;
+    Node *node;
+    while ((node = pop ()) != NULL)
+      std::free (node);
+  }
+
+  bool
+  push (const uint8_t *data, size_t size) {
+    Node *node = static_cast<Node *> (
+      std::malloc (offsetof (Node, data) + size));
+    if (node == NULL)
+      return false;
+    node->next = NULL;
+    node->size = size;
+    memcpy (node->data, data, size);
+    Node *prev = atomic_exchange (&head_, node);
+    // Between these two lines the queue is briefly cut at prev; the
+    // consumer sees that as empty and picks the rest up next flush.
+    atomic_store_release (&prev->next, node);
+    return true;
+  }
+
+  // Consumer side only, like flush
+  bool
+  empty () const {
+    return pending_count_ == 0 && tail_ == &stub_
+        && atomic_load_acquire (&stub_.next) == NULL;
+  }
+
+  // Writes out everything pushed so far, in order, through writev. Stops
+  // early if the port takes less than offered, keeping the rest for the
+  // next call. Appends what went out to written unless it is NULL.
+  size_t
+  flush (SerialImpl *pimpl, std::string *written) {
+    size_t total = 0;
+    while (true) {
+      Node *node;
+      while (pending_count_ < max_batch && (node = pop ()) != NULL)
+        pending_[pending_count_++] = node;
+      if (pending_count_ == 0)
+        break;
+
+      WriteBuffer buffers[max_batch];
+      size_t offered = 0;
+      for (size_t i = 0; i < pending_count_; ++i) {
+        size_t skip = (i == 0) ? pending_offset_ : 0;
+        buffers[i].data = pending_[i]->data + skip;
+        buffers[i].size = pending_[i]->size - skip;
+        offered += buffers[i].size;
+      }
+      size_t count = pimpl->writev (buffers, pending_count_);
+      total += count;
+      if (written != NULL)
+        append (buffers, count, written);
+      consume (count);
+      if (count < offered)
+        break;
+    }
+    return total;
+  }
+
+private:
+  // Disable copy constructors
+  WriteQueue (const WriteQueue&);
+  const WriteQueue& operator= (WriteQueue);
+
+  struct Node {
+    Node * volatile next;
+    size_t size;
+    uint8_t data[1];
+  };
+
+  static const size_t max_batch = 16;
+
+  // Oldest node, or NULL if there is none yet or a push is midway
+  Node *
+  pop () {
+    Node *tail = tail_;
+    Node *next = atomic_load_acquire (&tail->next);
+    if (tail == &stub_) {
+      if (next == NULL)
+        return NULL;
+      tail_ = tail = next;
+      next = atomic_load_acquire (&next->next);
+    }
+    if (next != NULL) {
+      tail_ = next;
+      return tail;
+    }
+    if (tail != atomic_load_acquire (&head_))
+      return NULL;
+    // tail is the last node; park the stub behind it so it can be taken
+    stub_.next = NULL;
+    Node *prev = atomic_exchange (&head_, &stub_);
+    atomic_store_release (&prev->next, &stub_);
+    next = atomic_load_acquire (&tail->next);
+    if (next != NULL) {
+      tail_ = next;
+      return tail;
+    }
+    return NULL;
+  }
+
+  // Appends the first count bytes of buffers to out
+  static void
+  append (const WriteBuffer *buffers, size_t count, std::string *out) {
+    for (size_t i = 0; count > 0; ++i) {
+      size_t size = min (buffers[i].size, count);
+      out->append (reinterpret_cast<const char *> (buffers[i].data), size);
+      count -= size;
+    }
+  }
+
+  // Drops the first count bytes of the pending nodes
+  void
+  consume (size_t count) {
+    size_t done = 0;
+    while (done < pending_count_) {
+      size_t left = pending_[done]->size - pending_offset_;
+      if (count < left) {
+        pending_offset_ += count;
+        break;
+      }
+      count -= left;
+      pending_offset_ = 0;
+      std::free (pending_[done]);
+      ++done;
+    }
+    for (size_t i = done; i < pending_count_; ++i)
+      pending_[i - done] = pending_[i];
+    pending_count_ -= done;
+  }
+
+  Node * volatile head_;           // producers
+  Node *tail_;                     // consumer
+  Node stub_;
+  Node *pending_[max_batch];       // popped but not yet written
+  size_t pending_count_;
+  size_t pending_offset_;          // bytes of pending_[0] already written
+};
+
 Serial::Serial (const string &port, uint32_t baudrate, serial::Timeout timeout,
                 bytesize_t bytesize, parity_t parity, stopbits_t stopbits,
                 flowcontrol_t flowcontrol)
  : pimpl_(new SerialImpl (port, baudrate, bytesize, parity,
-                                           stopbits, flowcontrol))
+                                           stopbits, flowcontrol)),
+   single_reader_(false), write_queue_(new WriteQueue ())
 {
   pimpl_->setTimeout(timeout);
 }
 
 Serial::~Serial ()
 {
+  delete write_queue_;
   delete pimpl_;
 }
 
@@ -123,14 +349,14 @@ Serial::read_ (uint8_t *buffer, size_t size)
 size_t
 Serial::read (uint8_t *buffer, size_t size)
 {
-  ScopedReadLock lock(this->pimpl_);
+  ScopedReadLock lock(this->pimpl_, !single_reader_);
   return this->pimpl_->read (buffer, size);
 }
 
 size_t
 Serial::read (std::vector<uint8_t> &buffer, size_t size)
 {
-  ScopedReadLock lock(this->pimpl_);
+  ScopedReadLock lock(this->pimpl_, !single_reader_);
   uint8_t *buffer_ = new uint8_t[size];
   size_t bytes_read = this->pimpl_->read (buffer_, size);
   buffer.insert (buffer.end (), buffer_, buffer_+bytes_read);
@@ -141,7 +367,7 @@ Serial::read (std::vector<uint8_t> &buffer, size_t size)
 size_t
 Serial::read (std::string &buffer, size_t size)
 {
-  ScopedReadLock lock(this->pimpl_);
+  ScopedReadLock lock(this->pimpl_, !single_reader_);
   uint8_t *buffer_ = new uint8_t[size];
   size_t bytes_read = this->pimpl_->read (buffer_, size);
   buffer.append (reinterpret_cast<const char*>(buffer_), bytes_read);
@@ -160,26 +386,10 @@ Serial::read (size_t size)
 size_t
 Serial::readline (string &buffer, size_t size, string eol)
 {
-  ScopedReadLock lock(this->pimpl_);
-  size_t eol_len = eol.length ();
+  ScopedReadLock lock(this->pimpl_, !single_reader_);
   uint8_t *buffer_ = static_cast<uint8_t*>
                               (alloca (size * sizeof (uint8_t)));
-  size_t read_so_far = 0;
-  while (true)
-  {
-    size_t bytes_read = this->read_ (buffer_ + read_so_far, 1);
-    read_so_far += bytes_read;
-    if (bytes_read == 0) {
-      break; // Timeout occured on reading 1 byte
-    }
-    if (string (reinterpret_cast<const char*>
-         (buffer_ + read_so_far - eol_len), eol_len) == eol) {
-      break; // EOL found
-    }
-    if (read_so_far == size) {
-      break; // Reached the maximum read length
-    }
-  }
+  size_t read_so_far = this->pimpl_->readline (buffer_, size, eol);
   buffer.append(reinterpret_cast<const char*> (buffer_), read_so_far);
   return read_so_far;
 }
@@ -195,39 +405,25 @@ Serial::readline (size_t size, string eol)
 vector<string>
 Serial::readlines (size_t size, string eol)
 {
-  ScopedReadLock lock(this->pimpl_);
+  ScopedReadLock lock(this->pimpl_, !single_reader_);
   std::vector<std::string> lines;
   size_t eol_len = eol.length ();
   uint8_t *buffer_ = static_cast<uint8_t*>
     (alloca (size * sizeof (uint8_t)));
   size_t read_so_far = 0;
-  size_t start_of_line = 0;
   while (read_so_far < size) {
-    size_t bytes_read = this->read_ (buffer_+read_so_far, 1);
-    read_so_far += bytes_read;
+    uint8_t *line = buffer_ + read_so_far;
+    size_t bytes_read = this->pimpl_->readline (line, size - read_so_far, eol);
     if (bytes_read == 0) {
-      if (start_of_line != read_so_far) {
-        lines.push_back (
-          string (reinterpret_cast<const char*> (buffer_ + start_of_line),
-            read_so_far - start_of_line));
-      }
-      break; // Timeout occured on reading 1 byte
+      break; // Timeout occured before another line started
     }
-    if (string (reinterpret_cast<const char*>
-         (buffer_ + read_so_far - eol_len), eol_len) == eol) {
-      // EOL found
-      lines.push_back(
-        string(reinterpret_cast<const char*> (buffer_ + start_of_line),
-          read_so_far - start_of_line));
-      start_of_line = read_so_far;
-    }
-    if (read_so_far == size) {
-      if (start_of_line != read_so_far) {
-        lines.push_back(
-          string(reinterpret_cast<const char*> (buffer_ + start_of_line),
-            read_so_far - start_of_line));
-      }
-      break; // Reached the maximum read length
+    lines.push_back (
+      string (reinterpret_cast<const char*> (line), bytes_read));
+    read_so_far += bytes_read;
+    if (bytes_read < eol_len ||
+        string (reinterpret_cast<const char*>
+          (line + bytes_read - eol_len), eol_len) != eol) {
+      break; // Timeout or maximum read length reached mid-line
     }
   }
   return lines;
@@ -255,6 +451,58 @@ Serial::write (const uint8_t *data, size_t size)
   return this->write_(data, size);
 }
 
+size_t
+Serial::writev (const WriteBuffer *buffers, size_t count)
+{
+  ScopedWriteLock lock(this->pimpl_);
+  return pimpl_->writev (buffers, count);
+}
+
+bool
+Serial::enqueueWrite (const uint8_t *data, size_t size)
+{
+  return write_queue_->push (data, size);
+}
+
+bool
+Serial::enqueueWrite (const string &data)
+{
+  return write_queue_->push (reinterpret_cast<const uint8_t*>(data.c_str()),
+                             data.length());
+}
+
+size_t
+Serial::flushWrites (string *written)
+{
+  ScopedWriteLock lock(this->pimpl_);
+  return write_queue_->flush (pimpl_, written);
+}
+
+bool
+Serial::hasQueuedWrites () const
+{
+  return !write_queue_->empty ();
+}
+
+void
+Serial::clearWrites ()
+{
+  ScopedWriteLock lock(this->pimpl_);
+  write_queue_->clear ();
+}
+
+void
+Serial::setSingleReader (bool single_reader)
+{
+  single_reader_ = single_reader;
+}
+
+bool
+Serial::getSingleReader () const
+{
+  return single_reader_;
+}
+
 size_t
 Serial::write_ (const uint8_t *data, size_t length)
 {
@@ -349,6 +597,30 @@ Serial::getFlowcontrol () const
   return pimpl_->getFlowcontrol ();
 }
 
+void
+Serial::setLowLatency (bool enabled)
+{
+  pimpl_->setLowLatency (enabled);
+}
+
+bool
+Serial::getLowLatency () const
+{
+  return pimpl_->getLowLatency ();
+}
+
+uint64_t
+Serial::getReadTimestamp () const
+{
+  return pimpl_->getReadTimestamp ();
+}
+
+uint32_t
+Serial::getByteTimeNs () const
+{
+  return pimpl_->getByteTimeNs ();
+}
+
 void Serial::flush ()
 {
   ScopedReadLock rlock(this->pimpl_);
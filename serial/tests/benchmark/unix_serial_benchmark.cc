@@ -0,0 +1,241 @@
+/* Microbenchmarks for the serial library, run against a pty.
+ *
+ * Measures read, readline, readlines and write across payload sizes,
+ * timeout configurations and baud settings, and prints operations per
+ * second with the median and 99th percentile latency of a single call.
+ * Operations per second cover the whole loop, including feeding the pty
+ * for the read cases, while latencies time the library call alone.
+ * A pty does not pace bytes at the baud rate, so the figures show the
+ * cost of the library itself; the baud rate only changes how long
+ * read waits for bytes it expects to be on the way.
+ *
+ * Usage: serial-benchmark [iterations]
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serial/serial.h"
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+using namespace serial;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+uint64_t
+now_ns ()
+{
+  timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t> (now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+struct Config {
+  const char *timeout_name;
+  Timeout timeout;
+  uint32_t baudrate;
+};
+
+struct Result {
+  double ops_per_sec;
+  double mb_per_sec;
+  double p50_us;
+  double p99_us;
+};
+
+// Reads and discards everything written to the port until told to stop
+struct Drain {
+  int fd;
+  volatile bool stop;
+};
+
+void *
+drain (void *arg)
+{
+  Drain *d = static_cast<Drain*> (arg);
+  char buf[4096];
+  while (!d->stop) {
+    fd_set readfds;
+    FD_ZERO (&readfds);
+    FD_SET (d->fd, &readfds);
+    timeval timeout = { 0, 10000 };
+    if (select (d->fd + 1, &readfds, NULL, NULL, &timeout) > 0) {
+      if (read (d->fd, buf, sizeof (buf)) < 0) {
+        break;
+      }
+    }
+  }
+  return NULL;
+}
+
+Result
+summarize (vector<uint64_t> &latencies, uint64_t elapsed_ns, size_t bytes)
+{
+  Result r;
+  std::sort (latencies.begin (), latencies.end ());
+  double seconds = elapsed_ns / 1e9;
+  r.ops_per_sec = latencies.size () / seconds;
+  r.mb_per_sec = bytes * latencies.size () / seconds / 1e6;
+  r.p50_us = latencies[latencies.size () / 2] / 1e3;
+  r.p99_us = latencies[latencies.size () * 99 / 100] / 1e3;
+  return r;
+}
+
+// A payload of size bytes made of lines of at most line_length bytes
+string
+make_payload (size_t size, size_t line_length)
+{
+  string payload (size, 'x');
+  for (size_t i = line_length - 1; i < size; i += line_length) {
+    payload[i] = '\n';
+  }
+  payload[size - 1] = '\n';
+  return payload;
+}
+
+enum Operation { READ, READLINE, READLINES, WRITE };
+
+const char *
+operation_name (Operation op)
+{
+  switch (op) {
+  case READ: return "read";
+  case READLINE: return "readline";
+  case READLINES: return "readlines";
+  default: return "write";
+  }
+}
+
+bool
+run (Operation op, size_t size, const Config &config, size_t iterations,
+     Result *result)
+{
+  int master_fd, slave_fd;
+  char name[100];
+  if (openpty (&master_fd, &slave_fd, name, NULL, NULL) == -1) {
+    perror ("openpty");
+    return false;
+  }
+  Serial port (string (name), config.baudrate, config.timeout);
+
+  // readline takes the payload as one line, readlines as 16 byte lines
+  string payload = make_payload (size, op == READLINES ? 16 : size);
+  vector<uint64_t> latencies;
+  latencies.reserve (iterations);
+  vector<uint8_t> buffer (size);
+  string line;
+  bool ok = true;
+
+  Drain d = { master_fd, false };
+  pthread_t thread;
+  if (op == WRITE) {
+    pthread_create (&thread, NULL, drain, &d);
+  }
+
+  uint64_t start = now_ns ();
+  for (size_t i = 0; i < iterations && ok; i++) {
+    if (op != WRITE && write (master_fd, payload.data (), size) != (ssize_t) size) {
+      ok = false;
+      break;
+    }
+    uint64_t before = now_ns ();
+    size_t done = 0;
+    switch (op) {
+    case READ:
+      done = port.read (&buffer[0], size);
+      break;
+    case READLINE:
+      line.clear ();
+      done = port.readline (line, size);
+      break;
+    case READLINES: {
+      vector<string> lines = port.readlines (size);
+      for (size_t j = 0; j < lines.size (); j++) {
+        done += lines[j].size ();
+      }
+      break;
+    }
+    case WRITE:
+      done = port.write (reinterpret_cast<const uint8_t*> (payload.data ()), size);
+      break;
+    }
+    latencies.push_back (now_ns () - before);
+    ok = done == size;
+  }
+  uint64_t elapsed = now_ns () - start;
+
+  if (op == WRITE) {
+    d.stop = true;
+    pthread_join (thread, NULL);
+  }
+  port.close ();
+  close (master_fd);
+  close (slave_fd);
+
+  if (!ok) {
+    fprintf (stderr, "%s of %lu bytes came up short\n", operation_name (op),
+             static_cast<unsigned long> (size));
+    return false;
+  }
+  *result = summarize (latencies, elapsed, size);
+  return true;
+}
+
+}  // namespace
+
+int main (int argc, char **argv)
+{
+  size_t iterations = argc > 1 ? strtoul (argv[1], NULL, 10) : 1000;
+  if (iterations == 0) {
+    fprintf (stderr, "usage: %s [iterations]\n", argv[0]);
+    return 2;
+  }
+
+  const Config configs[] = {
+    { "simple", Timeout::simpleTimeout (250), 115200 },
+    { "simple", Timeout::simpleTimeout (250), 9600 },
+    { "inter_byte", Timeout (1, 250, 0, 250, 0), 115200 },
+    { "inter_byte", Timeout (1, 250, 0, 250, 0), 9600 },
+  };
+  const Operation operations[] = { READ, READLINE, READLINES, WRITE };
+  // Reads stay under the 4095 bytes a pty buffers before the writer blocks
+  const size_t sizes[] = { 1, 16, 128, 1024 };
+
+  printf ("%-10s %6s %-10s %6s %12s %10s %10s %10s\n", "op", "bytes",
+          "timeout", "baud", "ops/s", "MB/s", "p50_us", "p99_us");
+
+  int failures = 0;
+  for (size_t o = 0; o < sizeof (operations) / sizeof (operations[0]); o++) {
+    for (size_t c = 0; c < sizeof (configs) / sizeof (configs[0]); c++) {
+      for (size_t s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++) {
+        Result r;
+        if (!run (operations[o], sizes[s], configs[c], iterations, &r)) {
+          failures++;
+          continue;
+        }
+        printf ("%-10s %6lu %-10s %6u %12.0f %10.2f %10.1f %10.1f\n",
+                operation_name (operations[o]),
+                static_cast<unsigned long> (sizes[s]),
+                configs[c].timeout_name, configs[c].baudrate,
+                r.ops_per_sec, r.mb_per_sec, r.p50_us, r.p99_us);
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
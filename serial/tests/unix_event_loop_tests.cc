@@ -0,0 +1,117 @@
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "serial/serial.h"
+#include "serial/event_loop.h"
+
+#if defined(__linux__)
+#include <pty.h>
+#else
+#include <util.h>
+#endif
+
+using namespace serial;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+class RecordingHandler : public EventLoop::Handler {
+public:
+  virtual void onReadable (Serial &serial) {
+    lines.push_back (serial.readline ());
+  }
+  vector<string> lines;
+};
+
+class EventLoopTests : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    for (int i = 0; i < 2; i++) {
+      char name[100];
+      if (openpty(&master_fd[i], &slave_fd[i], name, NULL, NULL) == -1) {
+        perror("openpty");
+        exit(127);
+      }
+      port[i] = new Serial(string(name), 115200, Timeout::simpleTimeout(250));
+      loop.add(*port[i], &handler[i]);
+    }
+  }
+
+  virtual void TearDown() {
+    for (int i = 0; i < 2; i++) {
+      loop.remove(*port[i]);
+      port[i]->close();
+      delete port[i];
+      close(master_fd[i]);
+      close(slave_fd[i]);
+    }
+  }
+
+  EventLoop loop;
+  RecordingHandler handler[2];
+  Serial * port[2];
+  int master_fd[2];
+  int slave_fd[2];
+};
+
+void *
+stopLater (void *loop)
+{
+  usleep (50000);
+  static_cast<EventLoop*> (loop)->stop ();
+  return NULL;
+}
+
+TEST_F(EventLoopTests, timeoutWorks) {
+  EXPECT_EQ(loop.runOnce(50), 0u);
+}
+
+TEST_F(EventLoopTests, dispatchesReadyPort) {
+  write(master_fd[1], "abc\n", 4);
+  EXPECT_EQ(loop.runOnce(250), 1u);
+  EXPECT_TRUE(handler[0].lines.empty());
+  ASSERT_EQ(handler[1].lines.size(), 1u);
+  EXPECT_EQ(handler[1].lines[0], string("abc\n"));
+}
+
+TEST_F(EventLoopTests, dispatchesBufferedData) {
+  // Both lines arrive together; the second is left in the receive buffer
+  // by the first readline and must still be dispatched.
+  write(master_fd[0], "abc\ndef\n", 8);
+  EXPECT_EQ(loop.runOnce(250), 1u);
+  EXPECT_EQ(loop.runOnce(0), 1u);
+  ASSERT_EQ(handler[0].lines.size(), 2u);
+  EXPECT_EQ(handler[0].lines[1], string("def\n"));
+  EXPECT_EQ(loop.runOnce(0), 0u);
+}
+
+TEST_F(EventLoopTests, stopWorks) {
+  pthread_t thread;
+  pthread_create(&thread, NULL, stopLater, &loop);
+  loop.run();
+  pthread_join(thread, NULL);
+}
+
+TEST_F(EventLoopTests, stopBeforeRunIsForgotten) {
+  // A stop with nothing running must not end the next run early
+  loop.stop();
+  write(master_fd[0], "abc\n", 4);
+  pthread_t thread;
+  pthread_create(&thread, NULL, stopLater, &loop);
+  loop.run();
+  pthread_join(thread, NULL);
+  EXPECT_EQ(handler[0].lines.size(), 1u);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
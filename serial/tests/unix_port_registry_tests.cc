@@ -0,0 +1,62 @@
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "serial/serial.h"
+#include "serial/port_registry.h"
+
+using namespace serial;
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const char kFtdi[] = "USB VID:PID=0403:6001 SNR=FT1234";
+
+TEST(PortRegistryTests, matchesWholeFields) {
+  EXPECT_TRUE(PortRegistry::matches(kFtdi, "SNR=FT1234"));
+  EXPECT_TRUE(PortRegistry::matches(kFtdi, "VID:PID=0403:6001"));
+  EXPECT_TRUE(PortRegistry::matches(kFtdi, "VID:PID=0403:6001 SNR=FT1234"));
+  EXPECT_FALSE(PortRegistry::matches(kFtdi, "SNR=FT12"));
+  EXPECT_FALSE(PortRegistry::matches(kFtdi, "VID:PID=0403:6001 SNR=FT9999"));
+}
+
+TEST(PortRegistryTests, matchesValues) {
+  EXPECT_TRUE(PortRegistry::matches(kFtdi, "FT1234"));
+  EXPECT_TRUE(PortRegistry::matches(kFtdi, "0403:6001 FT1234"));
+  EXPECT_FALSE(PortRegistry::matches(kFtdi, "0403"));
+}
+
+TEST(PortRegistryTests, emptyIdentityMatchesNothing) {
+  EXPECT_FALSE(PortRegistry::matches(kFtdi, ""));
+  EXPECT_FALSE(PortRegistry::matches(kFtdi, "  "));
+  PortRegistry registry;
+  PortInfo info;
+  EXPECT_FALSE(registry.findByIdentity("", &info));
+}
+
+TEST(PortRegistryTests, agreesWithListPorts) {
+  PortRegistry registry;
+  vector<PortInfo> listed = list_ports();
+  vector<PortInfo> known = registry.ports();
+  ASSERT_EQ(listed.size(), known.size());
+  for (size_t i = 0; i < listed.size(); i++) {
+    PortInfo info;
+    ASSERT_TRUE(registry.findByPort(listed[i].port, &info));
+    EXPECT_EQ(info.hardware_id, listed[i].hardware_id);
+  }
+}
+
+TEST(PortRegistryTests, unknownPortIsNotFound) {
+  PortRegistry registry;
+  PortInfo info;
+  EXPECT_FALSE(registry.findByPort("/dev/does-not-exist", &info));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -29,6 +29,12 @@ void loop()
 
 #include "serial/serial.h"
 
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+
 #if defined(__linux__)
 #include <pty.h>
 #else
@@ -41,6 +47,42 @@ using std::string;
 
 namespace {
 
+uint64_t
+monotonicNow ()
+{
+  timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t> (now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+void *
+writeRestLater (void *fd)
+{
+  usleep (50000);
+  write (*static_cast<int*> (fd), "bc\n", 3);
+  return NULL;
+}
+
+const int kProducers = 4;
+const int kMessages = 250;
+
+struct Producer {
+  Serial *port;
+  int id;
+};
+
+void *
+enqueueMessages (void *arg)
+{
+  Producer *producer = static_cast<Producer*> (arg);
+  for (int i = 0; i < kMessages; ++i) {
+    char message[16];
+    snprintf (message, sizeof (message), "%d:%04d\n", producer->id, i);
+    producer->port->enqueueWrite (string (message));
+  }
+  return NULL;
+}
+
 class SerialTests : public ::testing::Test {
 protected:
   virtual void SetUp() {
@@ -80,6 +122,98 @@ TEST_F(SerialTests, writeWorks) {
   EXPECT_EQ(string(buf, 4), string("abc\n"));
 }
 
+TEST_F(SerialTests, writevWorks) {
+  char buf[9] = "";
+  const uint8_t *abc = reinterpret_cast<const uint8_t*> ("abc");
+  const uint8_t *def = reinterpret_cast<const uint8_t*> ("def\n");
+  serial::WriteBuffer buffers[] = { { abc, 3 }, { abc, 0 }, { def, 4 } };
+  EXPECT_EQ(port1->writev(buffers, 3), 7u);
+  read(master_fd, buf, 7);
+  EXPECT_EQ(string(buf, 7), string("abcdef\n"));
+}
+
+TEST_F(SerialTests, enqueueWriteWorks) {
+  char buf[9] = "";
+  EXPECT_FALSE(port1->hasQueuedWrites());
+  EXPECT_TRUE(port1->enqueueWrite("abc"));
+  EXPECT_TRUE(port1->enqueueWrite(""));
+  EXPECT_TRUE(port1->enqueueWrite("def\n"));
+  EXPECT_TRUE(port1->hasQueuedWrites());
+  string written;
+  EXPECT_EQ(port1->flushWrites(&written), 7u);
+  EXPECT_EQ(written, string("abcdef\n"));
+  EXPECT_FALSE(port1->hasQueuedWrites());
+  EXPECT_EQ(port1->flushWrites(), 0u);
+  read(master_fd, buf, 7);
+  EXPECT_EQ(string(buf, 7), string("abcdef\n"));
+}
+
+TEST_F(SerialTests, clearWritesDropsQueue) {
+  char buf[4] = "";
+  EXPECT_TRUE(port1->enqueueWrite("abc"));
+  port1->clearWrites();
+  EXPECT_FALSE(port1->hasQueuedWrites());
+  EXPECT_EQ(port1->flushWrites(), 0u);
+  EXPECT_TRUE(port1->enqueueWrite("def"));
+  EXPECT_EQ(port1->flushWrites(), 3u);
+  read(master_fd, buf, 3);
+  EXPECT_EQ(string(buf, 3), string("def"));
+}
+
+TEST_F(SerialTests, enqueueWriteFromManyThreads) {
+  pthread_t threads[kProducers];
+  Producer producers[kProducers];
+  for (int p = 0; p < kProducers; ++p) {
+    producers[p].port = port1;
+    producers[p].id = p;
+    pthread_create(&threads[p], NULL, enqueueMessages, &producers[p]);
+  }
+
+  // Flush while the producers run, draining the master so the pty never
+  // fills up
+  const size_t expected = kProducers * kMessages * 7;
+  string received;
+  uint64_t deadline = monotonicNow() + 5000000000ULL;
+  while (received.size() < expected && monotonicNow() < deadline) {
+    port1->flushWrites();
+    char buf[4096];
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(master_fd, &readable);
+    timeval wait = { 0, 1000 };
+    if (select(master_fd + 1, &readable, NULL, NULL, &wait) > 0) {
+      ssize_t count = read(master_fd, buf, sizeof(buf));
+      if (count > 0)
+        received.append(buf, count);
+    }
+  }
+  for (int p = 0; p < kProducers; ++p)
+    pthread_join(threads[p], NULL);
+  ASSERT_EQ(received.size(), expected);
+
+  // Every message arrives whole, and each producer's in its own order
+  int next[kProducers] = { 0 };
+  for (size_t i = 0; i < received.size(); i += 7) {
+    int id = -1, index = -1;
+    ASSERT_EQ(sscanf(received.c_str() + i, "%d:%4d\n", &id, &index), 2);
+    ASSERT_EQ(received[i + 6], '\n');
+    ASSERT_TRUE(id >= 0 && id < kProducers);
+    EXPECT_EQ(index, next[id]);
+    next[id] = index + 1;
+  }
+  EXPECT_FALSE(port1->hasQueuedWrites());
+}
+
+TEST_F(SerialTests, singleReaderReads) {
+  port1->setSingleReader(true);
+  EXPECT_TRUE(port1->getSingleReader());
+  write(master_fd, "abc\ndef", 7);
+  EXPECT_EQ(port1->readline(), string("abc\n"));
+  EXPECT_EQ(port1->read(3), string("def"));
+  port1->setSingleReader(false);
+  EXPECT_FALSE(port1->getSingleReader());
+}
+
 TEST_F(SerialTests, timeoutWorks) {
   // Timeout a read, returns an empty string
   string empty = port1->read();
@@ -105,6 +239,106 @@ TEST_F(SerialTests, partialRead) {
   EXPECT_EQ(r, string("abc\n"));
 }
 
+TEST_F(SerialTests, readlineWorks) {
+  write(master_fd, "abc\ndef\n", 8);
+  EXPECT_EQ(port1->readline(), string("abc\n"));
+  EXPECT_EQ(port1->readline(), string("def\n"));
+
+  // A line without an EOL is returned when the read times out.
+  write(master_fd, "ghi", 3);
+  EXPECT_EQ(port1->readline(), string("ghi"));
+}
+
+TEST_F(SerialTests, readlineMultiByteEol) {
+  // The EOL is split across two writes.
+  write(master_fd, "abc\r", 4);
+  usleep(50000);
+  write(master_fd, "\ndef\r\n", 6);
+  EXPECT_EQ(port1->readline(65536, "\r\n"), string("abc\r\n"));
+  EXPECT_EQ(port1->readline(65536, "\r\n"), string("def\r\n"));
+}
+
+TEST_F(SerialTests, readlineMaxLength) {
+  write(master_fd, "abcdef\n", 7);
+  EXPECT_EQ(port1->readline(4), string("abcd"));
+  EXPECT_EQ(port1->readline(), string("ef\n"));
+}
+
+TEST_F(SerialTests, readAfterReadline) {
+  // Bytes buffered past the end of a line are still seen by read.
+  write(master_fd, "abc\ndef", 7);
+  EXPECT_EQ(port1->readline(), string("abc\n"));
+  EXPECT_EQ(port1->available(), 3u);
+  EXPECT_EQ(port1->read(3), string("def"));
+}
+
+TEST_F(SerialTests, readlinesWorks) {
+  write(master_fd, "abc\ndef\ngh", 10);
+  std::vector<string> lines = port1->readlines();
+  ASSERT_EQ(lines.size(), 3u);
+  EXPECT_EQ(lines[0], string("abc\n"));
+  EXPECT_EQ(lines[1], string("def\n"));
+  EXPECT_EQ(lines[2], string("gh"));
+}
+
+TEST_F(SerialTests, readTimestampIsFirstByte) {
+  // The line is stamped when it starts arriving, not when it completes.
+  EXPECT_EQ(port1->getReadTimestamp(), 0u);
+  write(master_fd, "a", 1);
+  pthread_t thread;
+  pthread_create(&thread, NULL, writeRestLater, &master_fd);
+  uint64_t before = monotonicNow();
+  EXPECT_EQ(port1->readline(), string("abc\n"));
+  uint64_t after = monotonicNow();
+  pthread_join(thread, NULL);
+  uint64_t stamp = port1->getReadTimestamp();
+  EXPECT_GE(stamp, before - 50000000ULL);
+  EXPECT_LT(stamp, before + 20000000ULL);
+  EXPECT_GE(after - stamp, 40000000ULL);
+}
+
+TEST_F(SerialTests, readTimestampPerLine) {
+  // Lines left in the receive buffer keep the time of their own chunk.
+  write(master_fd, "abc\n", 4);
+  EXPECT_EQ(port1->readline(), string("abc\n"));
+  uint64_t first = port1->getReadTimestamp();
+  write(master_fd, "def\n", 4);
+  usleep(20000);
+  EXPECT_EQ(port1->read(1), string("d"));
+  uint64_t second = port1->getReadTimestamp();
+  EXPECT_GT(second, first);
+  EXPECT_EQ(port1->readline(), string("ef\n"));
+}
+
+TEST_F(SerialTests, lowLatencyOnPty) {
+  // A pty has neither ASYNC_LOW_LATENCY nor a latency timer; asking for
+  // them must leave the port working.
+  port1->setLowLatency(true);
+  EXPECT_TRUE(port1->getLowLatency());
+  write(master_fd, "abc\n", 4);
+  EXPECT_EQ(port1->readline(), string("abc\n"));
+  port1->setLowLatency(false);
+  EXPECT_FALSE(port1->getLowLatency());
+}
+
+TEST_F(SerialTests, hangupThrowsAndCloses) {
+  // Closing the master is what the slave sees when an adapter goes away
+  close(master_fd);
+  EXPECT_THROW(port1->readline(), SerialException);
+  try {
+    port1->close();
+  } catch (IOException &) {
+  }
+  EXPECT_FALSE(port1->isOpen());
+}
+
+TEST_F(SerialTests, byteTimeFollowsBaudrate) {
+  // 8N1 is ten bits a character
+  EXPECT_NEAR(port1->getByteTimeNs(), 1e10 / 115200, 100);
+  port1->setBaudrate(9600);
+  EXPECT_NEAR(port1->getByteTimeNs(), 1e10 / 9600, 100);
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {